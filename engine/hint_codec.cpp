@@ -0,0 +1,378 @@
+/*
+ * Fledge omfhint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <hint_codec.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <string.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * The deepest nesting of maps and arrays accepted when decoding
+ */
+#define MAX_DEPTH	64
+
+/**
+ * Append a big endian integer of the given number of bytes
+ */
+static void putBigEndian(vector<uint8_t>& out, uint64_t value, int bytes)
+{
+	for (int i = bytes - 1; i >= 0; i--)
+		out.push_back((uint8_t)(value >> (i * 8)));
+}
+
+/**
+ * Append a MessagePack header for a type that has fixed, 8, 16 and 32 bit
+ * length forms.
+ *
+ * @param out		The output buffer
+ * @param len		The length, or count of elements
+ * @param fixType	The fixed form type, or 0 if there is no fixed form
+ * @param fixMax	The largest length of the fixed form
+ * @param type8		The type of the 8 bit form, or 0 if there is none
+ * @param type16	The type of the 16 bit form
+ * @param type32	The type of the 32 bit form
+ */
+static void putHeader(vector<uint8_t>& out, size_t len, uint8_t fixType, size_t fixMax, uint8_t type8, uint8_t type16, uint8_t type32)
+{
+	if (len <= fixMax)
+	{
+		out.push_back(fixType | (uint8_t)len);
+	}
+	else if (type8 && len <= 0xff)
+	{
+		out.push_back(type8);
+		putBigEndian(out, len, 1);
+	}
+	else if (len <= 0xffff)
+	{
+		out.push_back(type16);
+		putBigEndian(out, len, 2);
+	}
+	else
+	{
+		out.push_back(type32);
+		putBigEndian(out, len, 4);
+	}
+}
+
+/**
+ * Append a MessagePack string
+ */
+static void putString(vector<uint8_t>& out, const char *str, size_t len)
+{
+	putHeader(out, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+	out.insert(out.end(), str, str + len);
+}
+
+/**
+ * Escape the quotes within a hint, ready to be added to a reading as a
+ * string datapoint
+ *
+ * @param json		The hint JSON
+ * @return string	The escaped hint
+ */
+string
+HintCodec::escape(const string& json)
+{
+	string escaped = json;
+	string replace = "\\\"";
+	size_t pos = escaped.find("\"");
+	while( pos != std::string::npos)
+	{
+		escaped.replace(pos, 1, replace);
+		pos = escaped.find("\"", pos+replace.size());
+	}
+	return escaped;
+}
+
+/**
+ * Reverse the escaping of a hint. Every quote was preceded by an added
+ * backslash, which is removed.
+ *
+ * @param escaped	The escaped hint
+ * @return string	The hint JSON
+ */
+string
+HintCodec::unescape(const string& escaped)
+{
+	string json;
+	json.reserve(escaped.length());
+	for (char c : escaped)
+	{
+		if (c == '"' && !json.empty() && json.back() == '\\')
+			json.back() = c;
+		else
+			json.push_back(c);
+	}
+	return json;
+}
+
+/**
+ * Encode a hint as MessagePack
+ *
+ * @param hint	The hint JSON value
+ * @param out	The buffer to append the encoded hint to
+ */
+void
+HintCodec::encode(const Value& hint, vector<uint8_t>& out)
+{
+	if (hint.IsNull())
+	{
+		out.push_back(0xc0);
+	}
+	else if (hint.IsBool())
+	{
+		out.push_back(hint.GetBool() ? 0xc3 : 0xc2);
+	}
+	else if (hint.IsString())
+	{
+		putString(out, hint.GetString(), hint.GetStringLength());
+	}
+	else if (hint.IsUint64())
+	{
+		uint64_t value = hint.GetUint64();
+		if (value < 0x80)
+			out.push_back((uint8_t)value);
+		else if (value <= 0xff)
+			{ out.push_back(0xcc); putBigEndian(out, value, 1); }
+		else if (value <= 0xffff)
+			{ out.push_back(0xcd); putBigEndian(out, value, 2); }
+		else if (value <= 0xffffffff)
+			{ out.push_back(0xce); putBigEndian(out, value, 4); }
+		else
+			{ out.push_back(0xcf); putBigEndian(out, value, 8); }
+	}
+	else if (hint.IsInt64())
+	{
+		// Only negative values reach here
+		int64_t value = hint.GetInt64();
+		if (value >= -32)
+			out.push_back((uint8_t)value);
+		else if (value >= INT8_MIN)
+			{ out.push_back(0xd0); putBigEndian(out, (uint64_t)value, 1); }
+		else if (value >= INT16_MIN)
+			{ out.push_back(0xd1); putBigEndian(out, (uint64_t)value, 2); }
+		else if (value >= INT32_MIN)
+			{ out.push_back(0xd2); putBigEndian(out, (uint64_t)value, 4); }
+		else
+			{ out.push_back(0xd3); putBigEndian(out, (uint64_t)value, 8); }
+	}
+	else if (hint.IsNumber())
+	{
+		double value = hint.GetDouble();
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		out.push_back(0xcb);
+		putBigEndian(out, bits, 8);
+	}
+	else if (hint.IsArray())
+	{
+		putHeader(out, hint.Size(), 0x90, 15, 0, 0xdc, 0xdd);
+		for (Value::ConstValueIterator it = hint.Begin(); it != hint.End(); ++it)
+			encode(*it, out);
+	}
+	else if (hint.IsObject())
+	{
+		putHeader(out, hint.MemberCount(), 0x80, 15, 0, 0xde, 0xdf);
+		for (Value::ConstMemberIterator it = hint.MemberBegin(); it != hint.MemberEnd(); ++it)
+		{
+			putString(out, it->name.GetString(), it->name.GetStringLength());
+			encode(it->value, out);
+		}
+	}
+}
+
+/**
+ * Encode an escaped hint as MessagePack
+ *
+ * @param escaped	The escaped hint JSON
+ * @param out		The buffer to append the encoded hint to
+ * @return bool		False if the hint is not valid JSON
+ */
+bool
+HintCodec::encode(const string& escaped, vector<uint8_t>& out)
+{
+	Document doc;
+	string json = unescape(escaped);
+	if (!doc.Parse(json.c_str()))
+		return false;
+	encode(doc, out);
+	return true;
+}
+
+/**
+ * A decoder for MessagePack hints that writes the equivalent JSON
+ */
+class MessagePackDecoder {
+	public:
+		MessagePackDecoder(const uint8_t *data, size_t len, Writer<StringBuffer>& writer) :
+			m_data(data), m_end(data + len), m_writer(writer)
+		{
+		};
+		bool	value(int depth);
+		bool	done() const { return m_data == m_end; };
+	private:
+		bool	get(size_t bytes, uint64_t& value)
+		{
+			if ((size_t)(m_end - m_data) < bytes)
+				return false;
+			value = 0;
+			for (size_t i = 0; i < bytes; i++)
+				value = (value << 8) | *m_data++;
+			return true;
+		};
+		bool	string(size_t len, bool key);
+		bool	array(size_t count, int depth);
+		bool	map(size_t count, int depth);
+
+		const uint8_t		*m_data;
+		const uint8_t		*m_end;
+		Writer<StringBuffer>&	m_writer;
+};
+
+bool
+MessagePackDecoder::string(size_t len, bool key)
+{
+	if ((size_t)(m_end - m_data) < len)
+		return false;
+	const char *str = (const char *)m_data;
+	m_data += len;
+	return key ? m_writer.Key(str, len, true) : m_writer.String(str, len, true);
+}
+
+bool
+MessagePackDecoder::array(size_t count, int depth)
+{
+	m_writer.StartArray();
+	for (size_t i = 0; i < count; i++)
+		if (!value(depth + 1))
+			return false;
+	return m_writer.EndArray();
+}
+
+bool
+MessagePackDecoder::map(size_t count, int depth)
+{
+	m_writer.StartObject();
+	for (size_t i = 0; i < count; i++)
+	{
+		// Keys are always strings in a hint
+		uint64_t type, len;
+		if (!get(1, type))
+			return false;
+		if ((type & 0xe0) == 0xa0)
+			len = type & 0x1f;
+		else if (type < 0xd9 || type > 0xdb || !get(1 << (type - 0xd9), len))
+			return false;
+		if (!string(len, true) || !value(depth + 1))
+			return false;
+	}
+	return m_writer.EndObject();
+}
+
+bool
+MessagePackDecoder::value(int depth)
+{
+	uint64_t type, n;
+	if (depth > MAX_DEPTH || !get(1, type))
+		return false;
+
+	if (type < 0x80)
+		return m_writer.Uint64(type);
+	if (type >= 0xe0)
+		return m_writer.Int64((int8_t)type);
+	if ((type & 0xf0) == 0x80)
+		return map(type & 0x0f, depth);
+	if ((type & 0xf0) == 0x90)
+		return array(type & 0x0f, depth);
+	if ((type & 0xe0) == 0xa0)
+		return string(type & 0x1f, false);
+
+	switch (type)
+	{
+	case 0xc0:
+		return m_writer.Null();
+	case 0xc2:
+	case 0xc3:
+		return m_writer.Bool(type == 0xc3);
+	case 0xca:
+	{
+		if (!get(4, n))
+			return false;
+		uint32_t bits = (uint32_t)n;
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return m_writer.Double(value);
+	}
+	case 0xcb:
+	{
+		if (!get(8, n))
+			return false;
+		double value;
+		memcpy(&value, &n, sizeof(value));
+		return m_writer.Double(value);
+	}
+	case 0xcc: case 0xcd: case 0xce: case 0xcf:
+		return get(1 << (type - 0xcc), n) && m_writer.Uint64(n);
+	case 0xd0:
+		return get(1, n) && m_writer.Int64((int8_t)n);
+	case 0xd1:
+		return get(2, n) && m_writer.Int64((int16_t)n);
+	case 0xd2:
+		return get(4, n) && m_writer.Int64((int32_t)n);
+	case 0xd3:
+		return get(8, n) && m_writer.Int64((int64_t)n);
+	case 0xd9: case 0xda: case 0xdb:
+		return get(1 << (type - 0xd9), n) && string(n, false);
+	case 0xdc: case 0xdd:
+		return get(2 << (type - 0xdc), n) && array(n, depth);
+	case 0xde: case 0xdf:
+		return get(2 << (type - 0xde), n) && map(n, depth);
+	default:
+		// Binary and extension types are not used in hints
+		return false;
+	}
+}
+
+/**
+ * Decode a MessagePack hint to JSON
+ *
+ * @param data	The encoded hint
+ * @param len	The length of the encoded hint
+ * @param json	The decoded hint JSON, not escaped
+ * @return bool	False if the data is not a valid MessagePack hint
+ */
+bool
+HintCodec::decode(const uint8_t *data, size_t len, string& json)
+{
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	MessagePackDecoder decoder(data, len, writer);
+	if (!decoder.value(0) || !decoder.done())
+		return false;
+	json = buffer.GetString();
+	return true;
+}
+
+/**
+ * Create a data buffer datapoint value holding an encoded hint
+ *
+ * @param packed	The encoded hint
+ * @return		The datapoint value, owned by the caller
+ */
+DatapointValue *
+HintCodec::toDatapointValue(const vector<uint8_t>& packed)
+{
+	DataBuffer *buffer = new DataBuffer(1, packed.size());
+	memcpy(buffer->getData(), packed.data(), packed.size());
+	return new DatapointValue(buffer);
+}
@@ -0,0 +1,168 @@
+/*
+ * Fledge omfhint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <stdio.h>
+#include <hint_diagnostics.h>
+#include <logger.h>
+
+using namespace std;
+
+/**
+ * Constructor for the diagnostics
+ *
+ * @param interval	The interval in seconds between summaries
+ */
+HintDiagnostics::HintDiagnostics(time_t interval) :
+	m_interval(interval),
+	m_lastFlush(now()),
+	m_overflow(0)
+{
+}
+
+/**
+ * Destructor, log the summary of any warnings suppressed since the last
+ * summary
+ */
+HintDiagnostics::~HintDiagnostics()
+{
+	flush();
+}
+
+/**
+ * Return the time in seconds from the coarse monotonic clock. This is
+ * read from memory shared with the kernel, without a system call.
+ */
+time_t
+HintDiagnostics::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec;
+}
+
+/**
+ * Raise a warning
+ *
+ * @param key	The key that identifies the warning
+ * @param fmt	The printf format of the message
+ */
+void
+HintDiagnostics::warn(uint64_t key, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	report(key, false, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Raise an error
+ *
+ * @param key	The key that identifies the error
+ * @param fmt	The printf format of the message
+ */
+void
+HintDiagnostics::error(uint64_t key, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	report(key, true, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Log a diagnostic the first time its key is seen, otherwise only count
+ * it. The message of a repeated diagnostic is not formatted.
+ */
+void
+HintDiagnostics::report(uint64_t key, bool error, const char *fmt, va_list args)
+{
+	auto it = m_diagnostics.find(key);
+	if (it != m_diagnostics.end())
+	{
+		it->second.suppressed++;
+		return;
+	}
+	if (m_diagnostics.size() >= MAX_DIAGNOSTICS)
+	{
+		m_overflow++;
+		return;
+	}
+
+	char message[1024];
+	vsnprintf(message, sizeof(message), fmt, args);
+	if (error)
+		Logger::getLogger()->error("%s", message);
+	else
+		Logger::getLogger()->warn("%s", message);
+	Diagnostic diagnostic = { message, error, 0 };
+	m_diagnostics.insert(pair<uint64_t, Diagnostic>(key, diagnostic));
+}
+
+/**
+ * Log the summary if the interval has passed since the last summary
+ */
+void
+HintDiagnostics::poll()
+{
+	if (now() - m_lastFlush >= m_interval)
+		flush();
+}
+
+/**
+ * Log a summary line for each diagnostic that has been suppressed since
+ * the last summary
+ */
+void
+HintDiagnostics::flush()
+{
+	time_t flushed = now();
+	for (auto& item : m_diagnostics)
+	{
+		Diagnostic& diagnostic = item.second;
+		if (diagnostic.suppressed == 0)
+			continue;
+		if (diagnostic.error)
+			Logger::getLogger()->error("%s (repeated %lu times in %ld seconds)",
+					diagnostic.message.c_str(), diagnostic.suppressed, (long)(flushed - m_lastFlush));
+		else
+			Logger::getLogger()->warn("%s (repeated %lu times in %ld seconds)",
+					diagnostic.message.c_str(), diagnostic.suppressed, (long)(flushed - m_lastFlush));
+		diagnostic.suppressed = 0;
+	}
+	if (m_overflow)
+	{
+		Logger::getLogger()->warn("%lu further OMF hint warnings were not logged", m_overflow);
+		m_overflow = 0;
+	}
+	m_lastFlush = flushed;
+}
+
+/**
+ * Log the summary of any suppressed diagnostics and forget all of the
+ * diagnostics, so that they are logged again the next time they occur
+ */
+void
+HintDiagnostics::reset()
+{
+	flush();
+	m_diagnostics.clear();
+}
+
+/**
+ * Return the number of diagnostics suppressed since the last summary
+ */
+unsigned long
+HintDiagnostics::suppressed() const
+{
+	unsigned long count = m_overflow;
+	for (auto& item : m_diagnostics)
+		count += item.second.suppressed;
+	return count;
+}
@@ -0,0 +1,103 @@
+/*
+ * Fledge omfhint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <hint_trace.h>
+#include <logger.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Constructor for the tracer, create the trace file
+ *
+ * @param path		The path of the trace file
+ * @param sampleRate	Trace one reading in every sampleRate readings
+ */
+HintTracer::HintTracer(const string& path, unsigned long sampleRate) :
+	m_sampleRate(sampleRate > 0 ? sampleRate : 1),
+	m_count(0),
+	m_first(true),
+	m_epoch(steady_clock::now()),
+	m_pid(getpid())
+{
+	string dir = path.substr(0, path.rfind('/'));
+	mkdir(dir.c_str(), 0755);
+
+	m_file = fopen(path.c_str(), "w");
+	if (!m_file)
+	{
+		Logger::getLogger()->error("Unable to create OMF hint trace file %s: %s",
+				path.c_str(), strerror(errno));
+		return;
+	}
+	fputs("[\n", m_file);
+	Logger::getLogger()->info("Tracing one reading in %lu to %s", m_sampleRate, path.c_str());
+}
+
+/**
+ * Destructor for the tracer, complete and close the trace file
+ */
+HintTracer::~HintTracer()
+{
+	if (m_file)
+	{
+		fputs("\n]\n", m_file);
+		fclose(m_file);
+	}
+}
+
+/**
+ * Write a complete event for a stage of processing a reading
+ *
+ * @param name	The name of the stage
+ * @param asset	The asset name of the reading
+ * @param start	The time the stage started
+ * @param end	The time the stage ended
+ */
+void
+HintTracer::event(const char *name, const string& asset,
+		steady_clock::time_point start, steady_clock::time_point end)
+{
+	if (!m_file)
+		return;
+
+	// Asset names are written as JSON strings
+	string escaped;
+	escaped.reserve(asset.length());
+	for (char c : asset)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped.push_back('\\');
+			escaped.push_back(c);
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char code[7];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped.append(code);
+		}
+		else
+		{
+			escaped.push_back(c);
+		}
+	}
+
+	fprintf(m_file, "%s{\"name\":\"%s\",\"cat\":\"omfhint\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,\"args\":{\"asset\":\"%s\"}}",
+			m_first ? "" : ",\n", name,
+			duration<double, micro>(start - m_epoch).count(),
+			duration<double, micro>(end - start).count(),
+			m_pid, (long)syscall(SYS_gettid), escaped.c_str());
+	m_first = false;
+}
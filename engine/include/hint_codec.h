@@ -0,0 +1,44 @@
+#ifndef _HINT_CODEC_H
+#define _HINT_CODEC_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <datapoint.h>
+#include <rapidjson/document.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * The form in which hints are added to readings
+ */
+enum HintFormat {
+	HINT_FORMAT_JSON,	// A string datapoint holding the escaped JSON
+	HINT_FORMAT_MSGPACK	// A data buffer datapoint holding MessagePack
+};
+
+/**
+ * Conversion of hints between the escaped JSON string form and the
+ * compact MessagePack form. The MessagePack form is intended for readings
+ * sent from one Fledge to another, the receiving Fledge converts the hints
+ * back to JSON before they are sent to OMF.
+ */
+class HintCodec {
+	public:
+		static std::string
+				escape(const std::string& json);
+		static std::string
+				unescape(const std::string& escaped);
+		static void	encode(const rapidjson::Value& hint, std::vector<uint8_t>& out);
+		static bool	encode(const std::string& escaped, std::vector<uint8_t>& out);
+		static bool	decode(const uint8_t *data, size_t len, std::string& json);
+		static DatapointValue
+				*toDatapointValue(const std::vector<uint8_t>& packed);
+};
+#endif
@@ -0,0 +1,66 @@
+#ifndef _HINT_DIAGNOSTICS_H
+#define _HINT_DIAGNOSTICS_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <string>
+#include <unordered_map>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * The default interval in seconds between summaries of repeated warnings
+ */
+#define DIAGNOSTIC_INTERVAL	60
+
+/**
+ * The maximum number of distinct warnings that are tracked. Further
+ * distinct warnings are counted and included in the next summary.
+ */
+#define MAX_DIAGNOSTICS		1000
+
+/**
+ * Deduplicated warnings with periodic summaries. Each warning has a key
+ * chosen by the caller, for example the macro it concerns. The first
+ * occurrence of a warning is logged, later occurrences are only counted,
+ * so a warning raised for every reading costs one hash lookup. The owner
+ * calls poll() regularly, for example once per set of readings, and the
+ * counts are logged as a summary once the interval has passed.
+ *
+ * The diagnostics are not locked, the owner must not use them from more
+ * than one thread at a time.
+ */
+class HintDiagnostics {
+	public:
+		HintDiagnostics(time_t interval = DIAGNOSTIC_INTERVAL);
+		~HintDiagnostics();
+		void		warn(uint64_t key, const char *fmt, ...)
+					__attribute__((format(printf, 3, 4)));
+		void		error(uint64_t key, const char *fmt, ...)
+					__attribute__((format(printf, 3, 4)));
+		void		poll();
+		void		flush();
+		void		reset();
+		unsigned long	suppressed() const;
+	private:
+		struct Diagnostic {
+			std::string	message;
+			bool		error;
+			unsigned long	suppressed;
+		};
+		void		report(uint64_t key, bool error, const char *fmt, va_list args);
+		static time_t	now();
+
+		time_t						m_interval;
+		time_t						m_lastFlush;
+		std::unordered_map<uint64_t, Diagnostic>	m_diagnostics;
+		unsigned long					m_overflow;
+};
+#endif
@@ -0,0 +1,66 @@
+#ifndef _HINT_HASH_H
+#define _HINT_HASH_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#define FNV_OFFSET_BASIS	14695981039346656037ULL
+#define FNV_PRIME		1099511628211ULL
+
+/**
+ * Return the 64 bit FNV-1a hash of a block of data. Unlike std::hash the
+ * value is the same in every build and process, so it may be persisted
+ * or shared.
+ *
+ * @param data	The data to hash
+ * @param len	The length of the data
+ * @param hash	The hash to continue from
+ * @return	The hash value
+ */
+inline uint64_t hintHash(const char *data, size_t len, uint64_t hash = FNV_OFFSET_BASIS)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/**
+ * Return the 64 bit FNV-1a hash of a string
+ *
+ * @param str	The string to hash
+ * @param hash	The hash to continue from
+ * @return	The hash value
+ */
+inline uint64_t hintHash(const std::string& str, uint64_t hash = FNV_OFFSET_BASIS)
+{
+	return hintHash(str.data(), str.length(), hash);
+}
+
+/**
+ * Return the content hash ID of a hint. The ID depends only on the content
+ * of the hint, so a consumer may use it as the key of a cache of parsed
+ * hints.
+ *
+ * @param hint	The escaped hint JSON
+ * @return	The ID as 16 hexadecimal digits
+ */
+inline std::string hintId(const std::string& hint)
+{
+	char id[17];
+	snprintf(id, sizeof(id), "%016" PRIx64, hintHash(hint));
+	return std::string(id);
+}
+#endif
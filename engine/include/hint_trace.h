@@ -0,0 +1,83 @@
+#ifndef _HINT_TRACE_H
+#define _HINT_TRACE_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <string>
+#include <chrono>
+#include <stdio.h>
+
+/**
+ * Write the time spent in each stage of processing sampled readings to a
+ * file in the Chrome trace event format. The file may be loaded into
+ * chrome://tracing or Perfetto.
+ */
+class HintTracer {
+	public:
+		HintTracer(const std::string& path, unsigned long sampleRate);
+		~HintTracer();
+		/**
+		 * Return true if the next reading should be traced, one reading
+		 * in every sampleRate readings is traced
+		 */
+		bool		sample()
+				{
+					if (++m_count < m_sampleRate)
+						return false;
+					m_count = 0;
+					return m_file != NULL;
+				};
+		void		event(const char *name, const std::string& asset,
+					std::chrono::steady_clock::time_point start,
+					std::chrono::steady_clock::time_point end);
+	private:
+		FILE					*m_file;
+		unsigned long				m_sampleRate;
+		unsigned long				m_count;
+		bool					m_first;
+		std::chrono::steady_clock::time_point	m_epoch;
+		int					m_pid;
+};
+
+/**
+ * The trace of a single reading. Each call to mark() records the time
+ * since the previous mark as the named stage.
+ */
+class ReadingTrace {
+	public:
+		ReadingTrace(HintTracer& tracer, const std::string& asset) :
+			m_tracer(tracer), m_asset(asset),
+			m_start(std::chrono::steady_clock::now()), m_last(m_start)
+		{
+		};
+		void	mark(const char *stage)
+			{
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				m_tracer.event(stage, m_asset, m_last, now);
+				m_last = now;
+			};
+		void	finish()
+			{
+				m_tracer.event("reading", m_asset, m_start, std::chrono::steady_clock::now());
+			};
+	private:
+		HintTracer&				m_tracer;
+		const std::string&			m_asset;
+		std::chrono::steady_clock::time_point	m_start;
+		std::chrono::steady_clock::time_point	m_last;
+};
+
+/**
+ * The trace used when a reading is not traced, marks compile to nothing
+ */
+class NoTrace {
+	public:
+		void	mark(const char *) {};
+};
+#endif
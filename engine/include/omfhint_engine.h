@@ -0,0 +1,86 @@
+#ifndef _OMFHINT_ENGINE_H
+#define _OMFHINT_ENGINE_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <reading.h>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <stdint.h>
+#include <omfhint_rules.h>
+#include <hint_codec.h>
+#include <timestamp_format.h>
+#include <hint_trace.h>
+#include <hint_diagnostics.h>
+
+/**
+ * The OMF hint engine matches readings to the compiled hint rules and
+ * renders the hints for them. It holds the state that builds up as
+ * readings are processed, the resolution of asset names to wildcard rules,
+ * the schema hint decisions and the cached formatted timestamps, and
+ * shares the compiled rules with any other engine in the process with the
+ * same configuration.
+ *
+ * The engine does not depend on the Fledge filter lifecycle, it may be
+ * used by any component that needs the hint for an asset or reading. An
+ * engine is not thread safe, each thread should use its own engine.
+ */
+class OMFHintEngine {
+	public:
+		OMFHintEngine();
+		bool		configure(const std::string& hints,
+					const std::string& schemaHints = "{}",
+					bool caseInsensitive = false,
+					HintFormat format = HINT_FORMAT_JSON,
+					bool hintId = false,
+					bool prune = false);
+		const OMFHintRuleSet&
+				rules() const { return *m_rules; };
+		const OMFHint	*match(const std::string& asset);
+		const OMFHint	*match(Reading *reading);
+		void		render(Reading *reading, const OMFHint& hint, std::string& json);
+		void		prune(Reading *reading, const PrunedHint& pruned, std::string& json);
+		bool		apply(Reading *reading);
+		bool		apply(Reading *reading, ReadingTrace& trace);
+		void		decode(Reading *reading);
+		bool		cacheDirty() const { return m_cacheDirty; };
+		HintDiagnostics&
+				diagnostics() { return m_diagnostics; };
+		void		poll();
+		void		loadCache(const std::string& path);
+		void		saveCache(const std::string& path);
+	private:
+		const std::string&
+				foldAssetName(const std::string& asset);
+		template<class Trace>
+		int		resolveWildcard(const std::string& asset, Trace& trace);
+		const OMFHint	*matchSchema(Reading *reading, const std::string& asset);
+		const OMFHint	*selectVariant(Reading *reading, const OMFHint *hint);
+		template<class Trace>
+		const OMFHint	*matchAsset(const std::string& key, Trace& trace);
+		template<class Trace>
+		const OMFHint	*matchReading(Reading *reading, Trace& trace);
+		template<class Trace>
+		bool		applyHint(Reading *reading, Trace& trace);
+
+		std::shared_ptr<const OMFHintRuleSet>            m_rules;
+		bool                                             m_hintId;
+		std::unordered_map<std::string, int>             m_resolved;
+		bool                                             m_cacheDirty;
+		std::unordered_map<std::string, std::string>     m_folded;
+		std::string                                      m_foldBuffer;
+		std::unordered_map<uint64_t, const OMFHint *>
+		                                                 m_schemaCache;
+		TimestampFormat                                  m_timestampFormat;
+		TimestampFormat                                  m_userTimestampFormat;
+		HintDiagnostics                                  m_diagnostics;
+		HintDiagnostics                                  m_configDiagnostics;
+};
+#endif
@@ -0,0 +1,204 @@
+#ifndef _OMFHINT_RULES_H
+#define _OMFHINT_RULES_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <reading.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <regex>
+#include <memory>
+#include <stdint.h>
+#include <hint_codec.h>
+#include <hint_diagnostics.h>
+#include <rapidjson/document.h>
+
+/**
+ * An element of the path of a macro that refers to a datapoint nested within
+ * a dictionary or list datapoint. The index is used for list datapoints and
+ * is -1 if the element is not a number.
+ */
+struct MacroPathElement {
+	std::string	name;
+	int		index;
+};
+
+/**
+ * The source of the value that replaces a macro
+ */
+enum MacroType {
+	MACRO_DATAPOINT,	// The value of a datapoint
+	MACRO_ASSET,		// $ASSET$, the asset name
+	MACRO_TIMESTAMP,	// $TIMESTAMP$, the reading timestamp
+	MACRO_DATE,		// $DATE$, the date of the reading timestamp
+	MACRO_USER_TS,		// $USER_TS$, the user timestamp
+	MACRO_USER_DATE		// $USER_DATE$, the date of the user timestamp
+};
+
+/**
+ * A macro within a hint, the position of the macro in the hint and the
+ * path to the datapoint that gives the value of the macro.
+ */
+struct HintMacro {
+	MacroType			type;
+	std::string			name;
+	size_t				position;
+	std::vector<MacroPathElement>	path;
+};
+
+/**
+ * A hint ready to be added to readings. The JSON is escaped and the macros
+ * within it are found when the filter is configured. Hints without macros
+ * also hold the datapoint values of the hint, in the configured hint
+ * format, and its content hash ID, to copy into each reading.
+ */
+struct HintVariants;
+struct PrunedHint;
+struct OMFHint {
+	std::string			json;
+	std::vector<HintMacro>		macros;
+	std::shared_ptr<DatapointValue>	value;
+	std::shared_ptr<DatapointValue>	id;
+	std::shared_ptr<const HintVariants>
+					variants;
+	std::shared_ptr<const PrunedHint>
+					pruned;
+};
+
+/**
+ * A hint compiled so that only the datapoint hint entries for the
+ * datapoints present in a reading are added. The hint without the entries
+ * is used if none of the datapoints are present, otherwise the hint is the
+ * opening text followed by the fragments of the entries, all escaped.
+ */
+struct PrunedHint {
+	std::string					base;
+	std::string					open;
+	std::unordered_map<std::string, std::string>	fragments;
+};
+
+/**
+ * The variants of a hint, selected by the value of a datapoint. Each variant
+ * is the hint merged with the members given for that value, compiled when
+ * the filter is configured. If the reading has no variant the hint itself
+ * is used, unless it has no members other than the variants.
+ */
+struct HintVariants {
+	std::string					datapoint;
+	bool						hasDefault;
+	std::unordered_map<std::string, OMFHint>	values;
+};
+
+/**
+ * A wildcard hint rule, a regular expression asset name and the hint to
+ * apply. The compile time and estimated match cost are gathered when
+ * the filter is configured and reported by the rule analysis.
+ */
+struct WildcardRule {
+	std::string	pattern;
+	std::regex	regex;
+	OMFHint		hint;
+	double		compileTime;	// Microseconds to compile the regex
+	double		matchCost;	// Estimated nanoseconds per match attempt
+};
+
+/**
+ * A schema hint rule, the hint applies to readings that contain all of the
+ * named datapoints.
+ */
+struct SchemaRule {
+	std::vector<std::string>	datapoints;
+	OMFHint				hint;
+};
+
+/**
+ * The schema hint rules for an asset name or regular expression
+ */
+struct SchemaHint {
+	std::string		asset;
+	bool			isRegex;
+	std::regex		regex;
+	std::vector<SchemaRule>	rules;
+};
+
+/**
+ * The compiled set of OMF hint rules for a hints configuration. A rule set
+ * is immutable once it has been compiled and is shared, via get(), by all
+ * the filter instances in the process that have the same configuration.
+ * State that changes as readings are processed, such as the caches of
+ * asset name resolutions, belongs to each filter instance.
+ */
+class OMFHintRuleSet {
+	public:
+		OMFHintRuleSet(const std::string& hints,
+				const std::string& schemaHints,
+				bool caseInsensitive,
+				HintFormat format = HINT_FORMAT_JSON,
+				bool prune = false,
+				HintDiagnostics *diagnostics = NULL);
+		static std::shared_ptr<const OMFHintRuleSet>
+				get(const std::string& hints,
+					const std::string& schemaHints,
+					bool caseInsensitive,
+					HintFormat format = HINT_FORMAT_JSON,
+				bool prune = false,
+				HintDiagnostics *diagnostics = NULL);
+		static uint64_t	key(const std::string& hints,
+					const std::string& schemaHints,
+					bool caseInsensitive,
+					HintFormat format = HINT_FORMAT_JSON,
+				bool prune = false);
+		static std::string
+				foldCase(const std::string& str);
+
+		uint64_t	hash() const { return m_hash; };
+		bool		caseInsensitive() const { return m_caseInsensitive; };
+		HintFormat	format() const { return m_format; };
+		const std::string&
+				ruleReport() const { return m_ruleReport; };
+		const OMFHint	*exactHint(const std::string& asset) const;
+		size_t		wildcardCount() const { return m_wildcards.size(); };
+		int		matchWildcard(const std::string& asset) const;
+		const OMFHint	*wildcardHint(int index) const { return &m_wildcards[index].hint; };
+		bool		hasSchemaHints() const { return !m_schemaHints.empty(); };
+		const OMFHint	*matchSchema(Reading *reading, const std::string& asset) const;
+	private:
+		void		configureHints(const std::string& hints);
+		void		configureSchemaHints(const std::string& schemaHints);
+		void		addExactHint(const std::string& asset, const OMFHint& hint);
+		void		analyseRules(std::vector<WildcardRule>& candidates);
+		void		compileHint(const rapidjson::Value& value, OMFHint& hint);
+		void		prepareHint(const rapidjson::Value& value, OMFHint& hint);
+		void		prepareHint(OMFHint& hint);
+		void		preparePruned(const rapidjson::Value& value, OMFHint& hint);
+		void		collectMacrosInfo(OMFHint& hint);
+		std::regex::flag_type
+				regexFlags() const
+				{
+					return m_caseInsensitive ?
+						std::regex::ECMAScript | std::regex::icase :
+						std::regex::ECMAScript;
+				};
+
+		const std::string			m_hintsSource;
+		const std::string			m_schemaSource;
+		const bool				m_caseInsensitive;
+		const HintFormat			m_format;
+		const bool				m_prune;
+		const uint64_t				m_hash;
+		std::map<std::string, OMFHint>		m_hints;
+		std::vector<WildcardRule>		m_wildcards;
+		std::vector<SchemaHint>			m_schemaHints;
+		std::string				m_ruleReport;
+		// Only set while the rules are being compiled
+		HintDiagnostics				*m_diagnostics;
+};
+#endif
@@ -0,0 +1,34 @@
+#ifndef _TIMESTAMP_FORMAT_H
+#define _TIMESTAMP_FORMAT_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <string>
+#include <sys/time.h>
+
+/**
+ * Format reading timestamps for macro substitution. The formatted text is
+ * cached at second and day granularity so that readings within the same
+ * second or day reuse it rather than formatting the time for each reading.
+ * Times are formatted in UTC.
+ */
+class TimestampFormat {
+	public:
+		TimestampFormat();
+		const std::string&
+			dateTime(const struct timeval& tv);
+		const std::string&
+			date(time_t seconds);
+	private:
+		time_t		m_second;
+		std::string	m_dateTime;
+		time_t		m_day;
+		std::string	m_date;
+};
+#endif
@@ -0,0 +1,628 @@
+/*
+ * Fledge omfhint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <omfhint_engine.h>
+#include <hint_hash.h>
+#include <logger.h>
+#include <utility>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+/**
+ * The maximum number of asset names for which the wildcard rule resolution
+ * is remembered. Beyond this, asset names are matched against the wildcards
+ * each time they are seen.
+ */
+#define MAX_RESOLVED		10000
+
+/**
+ * Version of the persisted rule cache file
+ */
+#define CACHE_VERSION		1
+
+/**
+ * Constructor for the OMF hint engine. The engine has no hints until it
+ * is configured.
+ */
+OMFHintEngine::OMFHintEngine() : m_hintId(false), m_cacheDirty(false)
+{
+	m_rules = OMFHintRuleSet::get("{}", "{}", false);
+}
+
+/**
+ * Configure the engine. The compiled rules of any other engine in the
+ * process with the same configuration are shared.
+ *
+ * @param hints			The OMF hints JSON document
+ * @param schemaHints		The schema hints JSON document
+ * @param caseInsensitive	Asset names are matched without regard to case
+ * @param format		The form in which hints are added to readings
+ * @param hintId		Add the content hash ID of the hint to readings
+ * @param prune			Only add the datapoint hints for datapoints in the reading
+ * @return bool			True if the rules have changed
+ */
+bool
+OMFHintEngine::configure(const string& hints, const string& schemaHints,
+		bool caseInsensitive, HintFormat format, bool hintId, bool prune)
+{
+	m_hintId = hintId;
+
+	shared_ptr<const OMFHintRuleSet> rules = OMFHintRuleSet::get(hints, schemaHints, caseInsensitive, format, prune,
+			&m_configDiagnostics);
+	if (rules == m_rules)
+		return false;
+
+	// The cached resolutions refer to the previous rules
+	m_resolved.clear();
+	m_schemaCache.clear();
+	// The diagnostics are keyed by the macros of the previous rules
+	m_diagnostics.reset();
+	m_cacheDirty = false;
+	m_rules = rules;
+	return true;
+}
+
+/**
+ * Log the summaries of repeated warnings, for the readings and for the
+ * hints compiled by configure(), once the summary interval has passed.
+ * Called regularly, for example once for each set of readings.
+ */
+void
+OMFHintEngine::poll()
+{
+	m_diagnostics.poll();
+	m_configDiagnostics.poll();
+}
+
+/**
+ * Find the hint for an asset name. Only the hints for asset names and
+ * regular expressions are considered, schema hints need the reading. Variants
+ * of the hint are not selected.
+ *
+ * @param asset	The asset name
+ * @return	The hint or NULL if no hint applies
+ */
+const OMFHint *
+OMFHintEngine::match(const string& asset)
+{
+	NoTrace trace;
+	return matchAsset(m_rules->caseInsensitive() ? foldAssetName(asset) : asset, trace);
+}
+
+/**
+ * Find the hint for a reading. Schema hints take precedence over the hints
+ * for the asset name.
+ *
+ * @param reading	The reading
+ * @return		The hint or NULL if no hint applies
+ */
+const OMFHint *
+OMFHintEngine::match(Reading *reading)
+{
+	NoTrace trace;
+	return matchReading(reading, trace);
+}
+
+/**
+ * Add the OMFHint datapoint, and if configured the OMFHintId datapoint,
+ * for the hint that applies to a reading
+ *
+ * @param reading	The reading
+ * @return bool		True if a hint was added to the reading
+ */
+bool
+OMFHintEngine::apply(Reading *reading)
+{
+	NoTrace trace;
+	return applyHint(reading, trace);
+}
+
+/**
+ * Add the hint for a reading, recording the time taken by each stage
+ *
+ * @param reading	The reading
+ * @param trace		The trace of the reading
+ * @return bool		True if a hint was added to the reading
+ */
+bool
+OMFHintEngine::apply(Reading *reading, ReadingTrace& trace)
+{
+	return applyHint(reading, trace);
+}
+
+/**
+ * Find the hint for an asset name, an exact match or failing that the
+ * first matching wildcard rule
+ *
+ * @param key	The asset name, case folded if matching is case insensitive
+ * @param trace	The trace of the reading
+ * @return	The hint or NULL if no hint applies
+ */
+template<class Trace> const OMFHint *
+OMFHintEngine::matchAsset(const string& key, Trace& trace)
+{
+	const OMFHint *hint = m_rules->exactHint(key);
+	if (!hint && m_rules->wildcardCount() > 0)
+	{
+		int match = resolveWildcard(key, trace);
+		if (match >= 0)
+			hint = m_rules->wildcardHint(match);
+	}
+	return hint;
+}
+
+/**
+ * Find the hint for a reading, schema hints take precedence
+ *
+ * @param reading	The reading
+ * @param trace		The trace of the reading
+ * @return		The hint or NULL if no hint applies
+ */
+template<class Trace> const OMFHint *
+OMFHintEngine::matchReading(Reading *reading, Trace& trace)
+{
+	const string& name = reading->getAssetName();
+	const string& key = m_rules->caseInsensitive() ? foldAssetName(name) : name;
+	const OMFHint *hint = NULL;
+	if (m_rules->hasSchemaHints())
+		hint = matchSchema(reading, key);
+	if (!hint)
+		hint = matchAsset(key, trace);
+	if (hint && hint->variants)
+		hint = selectVariant(reading, hint);
+	return hint;
+}
+
+/**
+ * Select the variant of a hint for the value of a datapoint in a reading.
+ * String and integer datapoint values select variants.
+ *
+ * @param reading	The reading
+ * @param hint		The hint with variants
+ * @return		The variant, the hint itself if there is no variant for
+ *			the reading, or NULL if the hint has only variants
+ */
+const OMFHint *
+OMFHintEngine::selectVariant(Reading *reading, const OMFHint *hint)
+{
+	const HintVariants& variants = *hint->variants;
+	Datapoint *datapoint = reading->getDatapoint(variants.datapoint);
+	if (datapoint)
+	{
+		const DatapointValue& value = datapoint->getData();
+		auto it = variants.values.end();
+		if (value.getType() == DatapointValue::T_STRING)
+			it = variants.values.find(value.toStringValue());
+		else if (value.getType() == DatapointValue::T_INTEGER)
+			it = variants.values.find(to_string(value.toInt()));
+		if (it != variants.values.end())
+			return &it->second;
+	}
+	return variants.hasDefault ? hint : NULL;
+}
+
+/**
+ * Add the hint datapoints to a reading. The trace is NoTrace when the
+ * reading is not traced, the marks then compile to nothing.
+ *
+ * @param reading	The reading
+ * @param trace		The trace of the reading
+ * @return bool		True if a hint was added to the reading
+ */
+template<class Trace> bool
+OMFHintEngine::applyHint(Reading *reading, Trace& trace)
+{
+	const OMFHint *hint = matchReading(reading, trace);
+	trace.mark("lookup");
+	if (!hint)
+		return false;
+
+	if (hint->value && !hint->pruned)
+	{
+		reading->addDatapoint(new Datapoint("OMFHint", *hint->value));
+		if (m_hintId)
+			reading->addDatapoint(new Datapoint("OMFHintId", *hint->id));
+		trace.mark("datapoint");
+		return true;
+	}
+
+	std::string hintsJSON;
+	if (hint->pruned)
+	{
+		prune(reading, *hint->pruned, hintsJSON);
+		trace.mark("prune");
+	}
+	else
+	{
+		hintsJSON = hint->json;
+		render(reading, *hint, hintsJSON);
+		trace.mark("macros");
+	}
+	vector<uint8_t> packed;
+	if (m_rules->format() == HINT_FORMAT_MSGPACK && HintCodec::encode(hintsJSON, packed))
+	{
+		DatapointValue *value = HintCodec::toDatapointValue(packed);
+		trace.mark("render");
+		reading->addDatapoint(new Datapoint("OMFHint", *value));
+		delete value;
+	}
+	else
+	{
+		DatapointValue value(hintsJSON);
+		trace.mark("render");
+		reading->addDatapoint(new Datapoint("OMFHint", value));
+	}
+	if (m_hintId)
+	{
+		DatapointValue id(hintId(hintsJSON));
+		reading->addDatapoint(new Datapoint("OMFHintId", id));
+	}
+	trace.mark("datapoint");
+	return true;
+}
+
+/**
+ * Build the hint for a reading from the fragments of a pruned hint, only
+ * the datapoint hint entries for datapoints in the reading are included
+ *
+ * @param reading	The reading
+ * @param pruned	The compiled fragments of the hint
+ * @param json		The escaped hint
+ */
+void
+OMFHintEngine::prune(Reading *reading, const PrunedHint& pruned, string& json)
+{
+	bool first = true;
+	for (auto datapoint : reading->getReadingData())
+	{
+		auto it = pruned.fragments.find(datapoint->getName());
+		if (it == pruned.fragments.end())
+			continue;
+		if (first)
+		{
+			json = pruned.open;
+			first = false;
+		}
+		else
+		{
+			json += ',';
+		}
+		json += it->second;
+	}
+	if (first)
+		json = pruned.base;
+	else
+		json += "]}";
+}
+
+/**
+ * Convert an OMFHint datapoint encoded as MessagePack, by a filter in
+ * another Fledge instance, back to the escaped JSON string form
+ *
+ * @param reading	The reading
+ */
+void
+OMFHintEngine::decode(Reading *reading)
+{
+	Datapoint *dp = reading->getDatapoint("OMFHint");
+	if (!dp || dp->getData().getType() != DatapointValue::T_DATABUFFER)
+		return;
+
+	DataBuffer *buffer = dp->getData().getDataBuffer();
+	string json;
+	if (!HintCodec::decode((const uint8_t *)buffer->getData(),
+				buffer->getItemCount() * buffer->getItemSize(), json))
+	{
+		m_diagnostics.warn(hintHash(reading->getAssetName()),
+				"The OMFHint datapoint of asset %s is not a valid MessagePack hint",
+				reading->getAssetName().c_str());
+		return;
+	}
+	delete reading->removeDatapoint("OMFHint");
+	DatapointValue value(HintCodec::escape(json));
+	reading->addDatapoint(new Datapoint("OMFHint", value));
+}
+
+/**
+ * Find the schema hint for a reading, based on the asset name and the set
+ * of datapoint names in the reading. A fingerprint of the asset name and
+ * datapoint names is computed and the decision for each fingerprint is
+ * remembered, so the datapoint sets are only compared the first time a
+ * fingerprint is seen. The fingerprint does not depend on the order of
+ * the datapoints within the reading.
+ *
+ * @param reading	The reading
+ * @param asset		The asset name, case folded if matching is case insensitive
+ * @return		The hint or NULL if no schema hint applies
+ */
+const OMFHint *
+OMFHintEngine::matchSchema(Reading *reading, const string& asset)
+{
+	const vector<Datapoint *>& datapoints = reading->getReadingData();
+	uint64_t setHash = datapoints.size();
+	for (auto dp : datapoints)
+	{
+		// Mix each name hash so that the sum is order independent
+		uint64_t h = hintHash(dp->getName());
+		setHash += (h ^ (h >> 29)) * FNV_PRIME;
+	}
+	uint64_t fingerprint = hintHash(asset, setHash);
+
+	auto it = m_schemaCache.find(fingerprint);
+	if (it != m_schemaCache.end())
+		return it->second;
+
+	const OMFHint *hint = m_rules->matchSchema(reading, asset);
+	if (m_schemaCache.size() < MAX_RESOLVED)
+		m_schemaCache.insert(pair<uint64_t, const OMFHint *>(fingerprint, hint));
+	return hint;
+}
+
+/**
+ * Return the case folded form of an asset name. Each distinct asset name is
+ * only folded once, the folded name is then remembered.
+ *
+ * @param asset	The asset name
+ * @return	The case folded asset name
+ */
+const string&
+OMFHintEngine::foldAssetName(const string& asset)
+{
+	auto it = m_folded.find(asset);
+	if (it != m_folded.end())
+		return it->second;
+	if (m_folded.size() >= MAX_RESOLVED)
+	{
+		m_foldBuffer = OMFHintRuleSet::foldCase(asset);
+		return m_foldBuffer;
+	}
+	return m_folded.insert(pair<string, string>(asset, OMFHintRuleSet::foldCase(asset))).first->second;
+}
+
+/**
+ * Find the first wildcard rule that matches an asset name. The result is
+ * remembered for each asset name so that the regular expressions are only
+ * tried the first time an asset is seen.
+ *
+ * @param asset	The asset name
+ * @param trace	The trace of the reading
+ * @return int	The index of the matching wildcard rule or -1 if none match
+ */
+template<class Trace> int
+OMFHintEngine::resolveWildcard(const string& asset, Trace& trace)
+{
+	auto it = m_resolved.find(asset);
+	if (it != m_resolved.end())
+		return it->second;
+
+	trace.mark("lookup");
+	int match = m_rules->matchWildcard(asset);
+	trace.mark("regex");
+	if (m_resolved.size() < MAX_RESOLVED)
+	{
+		m_resolved.insert(pair<string, int>(asset, match));
+		m_cacheDirty = true;
+	}
+	return match;
+}
+
+/**
+ * Load the persisted wildcard resolution table. The cache is only used if it
+ * was written for the same hints document as the current configuration,
+ * otherwise it is ignored and will be replaced when the cache is next saved.
+ *
+ * The standard library has no serialised form for a compiled regular
+ * expression, so the wildcard rules themselves are always compiled from the
+ * configuration. The cache records the number of active wildcards and, for
+ * each asset name seen, the index of the wildcard that matches it, allowing
+ * the regular expressions to be skipped for those assets after a restart.
+ *
+ * @param path	The path of the cache file
+ */
+void
+OMFHintEngine::loadCache(const string& path)
+{
+	ifstream in(path);
+	if (!in)
+		return;
+
+	int version;
+	uint64_t hash;
+	size_t nWildcards;
+	in >> version >> hex >> hash >> dec >> nWildcards;
+	if (!in || version != CACHE_VERSION)
+	{
+		Logger::getLogger()->warn("OMF hint cache %s is not a valid cache file, it will be ignored",
+				path.c_str());
+		return;
+	}
+	if (hash != m_rules->hash() || nWildcards != m_rules->wildcardCount())
+	{
+		Logger::getLogger()->info("OMF hint cache %s was written for a different configuration, it will be ignored",
+				path.c_str());
+		return;
+	}
+
+	int match;
+	size_t len;
+	char sep;
+	while (in >> match >> len && in.get(sep) && sep == ':')
+	{
+		string asset(len, '\0');
+		if (!in.read(&asset[0], len))
+			break;
+		if (match >= (int)nWildcards || m_resolved.size() >= MAX_RESOLVED)
+			continue;
+		m_resolved.insert(pair<string, int>(asset, match < 0 ? -1 : match));
+	}
+	Logger::getLogger()->info("Loaded %lu asset resolutions from OMF hint cache", m_resolved.size());
+}
+
+/**
+ * Write the wildcard resolution table to the cache file. The file is written
+ * to a temporary name and then renamed so that a crash while writing does
+ * not leave a partial cache.
+ *
+ * @param path	The path of the cache file
+ */
+void
+OMFHintEngine::saveCache(const string& path)
+{
+	m_cacheDirty = false;
+
+	string dir = path.substr(0, path.rfind('/'));
+	mkdir(dir.c_str(), 0755);
+
+	string tmpPath = path + ".tmp";
+	ofstream out(tmpPath, ios::trunc);
+	if (!out)
+	{
+		Logger::getLogger()->error("Unable to create OMF hint cache file %s", tmpPath.c_str());
+		return;
+	}
+	out << CACHE_VERSION << " " << hex << m_rules->hash() << dec << " " << m_rules->wildcardCount() << "\n";
+	for (auto& item : m_resolved)
+	{
+		out << item.second << " " << item.first.length() << ":" << item.first << "\n";
+	}
+	out.close();
+	if (!out || rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		Logger::getLogger()->error("Unable to write OMF hint cache file %s", path.c_str());
+		unlink(tmpPath.c_str());
+	}
+}
+
+/**
+ * Follow the path of a macro that refers to a datapoint nested within
+ * dictionary or list datapoints. Dictionary members are found by name
+ * and list elements by index.
+ *
+ * @param reading	Reading
+ * @param path		The path of the macro
+ * @return		The nested datapoint or NULL if it does not exist
+ */
+static Datapoint *resolvePath(Reading *reading, const std::vector<MacroPathElement>& path)
+{
+	Datapoint *datapoint = reading->getDatapoint(path[0].name);
+	for (size_t i = 1; datapoint && i < path.size(); i++)
+	{
+		DatapointValue& value = datapoint->getData();
+		Datapoint *child = NULL;
+		if (value.getType() == DatapointValue::dataTagType::T_DP_LIST)
+		{
+			std::vector<Datapoint *> *elements = value.getDpVec();
+			if (path[i].index >= 0 && (size_t)path[i].index < elements->size())
+				child = (*elements)[path[i].index];
+		}
+		else if (value.getType() == DatapointValue::dataTagType::T_DP_DICT)
+		{
+			for (auto member : *value.getDpVec())
+			{
+				if (member->getName() == path[i].name)
+				{
+					child = member;
+					break;
+				}
+			}
+		}
+		datapoint = child;
+	}
+	return datapoint;
+}
+
+/**
+ * Render a hint for a reading, replacing the macros with datapoint values
+ *
+ * @param reading	Reading
+ * @param hint		The OMF hint
+ * @param hintsJson	OMFHints JSON
+ */
+void OMFHintEngine::render(Reading *reading, const OMFHint& hint, std::string &hintsJSON)
+{
+	// Replace Macros by datapoint value
+	for (auto it =  hint.macros.rbegin(); it != hint.macros.rend(); ++it)
+	{
+		// In case of ASSET Macro, replace it by asset name instead of datapoint value
+		if ((*it).type == MACRO_ASSET)
+		{
+			hintsJSON.replace((*it).position, (*it).name.length()+2, reading->getAssetName() );
+			continue;
+		}
+		// Reading metadata macros, the formatted times are cached
+		if ((*it).type != MACRO_DATAPOINT)
+		{
+			struct timeval tv;
+			const string *formatted;
+			switch ((*it).type)
+			{
+				case MACRO_TIMESTAMP:
+					reading->getTimestamp(&tv);
+					formatted = &m_timestampFormat.dateTime(tv);
+					break;
+				case MACRO_DATE:
+					reading->getTimestamp(&tv);
+					formatted = &m_timestampFormat.date(tv.tv_sec);
+					break;
+				case MACRO_USER_TS:
+					reading->getUserTimestamp(&tv);
+					formatted = &m_userTimestampFormat.dateTime(tv);
+					break;
+				default:
+					reading->getUserTimestamp(&tv);
+					formatted = &m_userTimestampFormat.date(tv.tv_sec);
+					break;
+			}
+			hintsJSON.replace((*it).position, (*it).name.length()+2, *formatted);
+			continue;
+		}
+		Datapoint * datapoint = reading->getDatapoint((*it).name);
+		if (!datapoint && (*it).path.size() > 1)
+			datapoint = resolvePath(reading, (*it).path);
+
+		if (datapoint)
+		{
+			// Check for datapoint type for string and numbers
+			DatapointValue::dataTagType dataType = datapoint->getData().getType();
+			if (
+				dataType != DatapointValue::dataTagType::T_STRING &&
+				dataType != DatapointValue::dataTagType::T_INTEGER &&
+				dataType != DatapointValue::dataTagType::T_FLOAT
+			)
+			{
+				// This is called for every reading, the macro of the
+				// hint identifies the warning so repeats are only counted
+				m_diagnostics.warn((uint64_t)(uintptr_t)&(*it),
+						"The datapoint %s cannot be used as a macro substitution in the OMF Hint for asset %s as it is not a string or numeric value",
+						(*it).name.c_str(), reading->getAssetName().c_str());
+				continue;
+			}
+			string datapointValue = "";
+			switch (dataType)
+			{
+				case DatapointValue::dataTagType::T_INTEGER: 
+					datapointValue = std::to_string(datapoint->getData().toInt());
+					break;
+				case DatapointValue::dataTagType::T_FLOAT: 
+					datapointValue = std::to_string(datapoint->getData().toDouble());
+					break;
+				default: 
+				datapointValue = datapoint->getData().toStringValue();
+				break;
+			}
+			hintsJSON.replace((*it).position, (*it).name.length()+2, datapointValue );
+		}
+	}
+}
@@ -0,0 +1,815 @@
+/*
+ * Fledge omfhint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <stdio.h>
+#include <reading.h>
+#include <logger.h>
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+#include "rapidjson/stringbuffer.h"
+#include <rapidjson/writer.h>
+#include <omfhint_rules.h>
+#include <hint_hash.h>
+#include <string_utils.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <mutex>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * The registry of compiled rule sets, keyed by the hash of the configuration
+ * they were compiled from. The registry holds weak references, a rule set is
+ * freed when the last filter instance using it releases it.
+ */
+static mutex						registryMutex;
+static map<uint64_t, weak_ptr<const OMFHintRuleSet>>	registry;
+
+/**
+ * Serialise a hint and escape the quotes within it, ready to be added to
+ * a reading as a string datapoint.
+ *
+ * @param hint		The hint JSON value
+ * @return string	The escaped hint
+ */
+static string escapeHint(const Value& hint)
+{
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	hint.Accept(writer);
+
+	return HintCodec::escape(buffer.GetString());
+}
+
+/**
+ * Return the key of the rule set for a configuration
+ *
+ * @param hints			The OMF hints JSON document
+ * @param schemaHints		The schema hints JSON document
+ * @param caseInsensitive	Asset names are matched without regard to case
+ * @param format		The form in which hints are added to readings
+ * @param prune			Only add the datapoint hints for datapoints in the reading
+ * @return uint64_t		The key
+ */
+uint64_t
+OMFHintRuleSet::key(const string& hints, const string& schemaHints, bool caseInsensitive, HintFormat format, bool prune)
+{
+	uint64_t hash = hintHash(caseInsensitive ? "icase" : "case");
+	hash = hintHash(format == HINT_FORMAT_MSGPACK ? "msgpack" : "json", hash);
+	hash = hintHash(prune ? "prune" : "full", hash);
+	hash = hintHash(schemaHints, hash);
+	return hintHash(hints, hash);
+}
+
+/**
+ * Return the compiled rule set for a configuration. If another filter
+ * instance in the process already has a rule set for the same
+ * configuration it is shared, otherwise a new rule set is compiled.
+ *
+ * @param hints			The OMF hints JSON document
+ * @param schemaHints		The schema hints JSON document
+ * @param caseInsensitive	Asset names are matched without regard to case
+ * @param format		The form in which hints are added to readings
+ * @param prune			Only add the datapoint hints for datapoints in the reading
+ * @param diagnostics		The diagnostics for warnings found if the rules are compiled
+ * @return			The shared rule set
+ */
+shared_ptr<const OMFHintRuleSet>
+OMFHintRuleSet::get(const string& hints, const string& schemaHints, bool caseInsensitive, HintFormat format, bool prune, HintDiagnostics *diagnostics)
+{
+	uint64_t hash = key(hints, schemaHints, caseInsensitive, format, prune);
+
+	lock_guard<mutex> guard(registryMutex);
+	auto it = registry.find(hash);
+	if (it != registry.end())
+	{
+		shared_ptr<const OMFHintRuleSet> rules = it->second.lock();
+		// Guard against hash collisions by comparing the configuration
+		if (rules && rules->m_caseInsensitive == caseInsensitive
+				&& rules->m_format == format
+				&& rules->m_prune == prune
+				&& rules->m_hintsSource == hints
+				&& rules->m_schemaSource == schemaHints)
+		{
+			Logger::getLogger()->debug("Sharing the compiled OMF hint rule set %016lx", hash);
+			return rules;
+		}
+	}
+
+	// Remove the entries for rule sets that are no longer in use
+	for (it = registry.begin(); it != registry.end(); )
+	{
+		if (it->second.expired())
+			it = registry.erase(it);
+		else
+			++it;
+	}
+
+	shared_ptr<const OMFHintRuleSet> rules = make_shared<const OMFHintRuleSet>(hints, schemaHints, caseInsensitive, format, prune, diagnostics);
+	registry[hash] = rules;
+	return rules;
+}
+
+/**
+ * Constructor for a rule set, compile the hints and schema hints
+ *
+ * @param hints			The OMF hints JSON document
+ * @param schemaHints		The schema hints JSON document
+ * @param caseInsensitive	Asset names are matched without regard to case
+ * @param format		The form in which hints are added to readings
+ * @param prune			Only add the datapoint hints for datapoints in the reading
+ * @param diagnostics		The diagnostics for the warnings found, if NULL the
+ *				warnings are logged every time the rules are compiled
+ */
+OMFHintRuleSet::OMFHintRuleSet(const string& hints, const string& schemaHints, bool caseInsensitive, HintFormat format, bool prune, HintDiagnostics *diagnostics) :
+	m_hintsSource(hints),
+	m_schemaSource(schemaHints),
+	m_caseInsensitive(caseInsensitive),
+	m_format(format),
+	m_prune(prune),
+	m_hash(key(hints, schemaHints, caseInsensitive, format, prune))
+{
+	HintDiagnostics local;
+	m_diagnostics = diagnostics ? diagnostics : &local;
+	configureSchemaHints(schemaHints);
+	configureHints(hints);
+	m_diagnostics = NULL;
+}
+
+/**
+ * Compile the OMF hints. Hints for asset names are added to the map of
+ * exact asset names, those for regular expressions are analysed and
+ * become the wildcard rules.
+ *
+ * @param hints		The OMF hints JSON document
+ */
+void
+OMFHintRuleSet::configureHints(const string& hints)
+{
+	vector<WildcardRule> candidates;
+
+	Document doc;
+	ParseResult result = doc.Parse(hints.c_str());
+	if (!result)
+	{
+		m_diagnostics->error(hintHash(hints, hintHash("hints")),
+			"Error parsing OMF Hints: %s at %u",
+			GetParseError_En(doc.GetParseError()), (unsigned int)result.Offset());
+		return;
+	}
+	for (Value::ConstMemberIterator itr = doc.MemberBegin(); itr != doc.MemberEnd(); ++itr)
+	{
+		string asset = itr->name.GetString();
+		OMFHint hint;
+		compileHint(itr->value, hint);
+
+		if (IsRegex(asset))
+		{
+			try {
+				auto start = chrono::steady_clock::now();
+				WildcardRule rule = { asset, std::regex(asset, regexFlags()), hint, 0.0, 0.0 };
+				rule.compileTime = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+				candidates.push_back(rule);
+			} catch (const std::regex_error& e) {
+				m_diagnostics->warn(hintHash(asset, hintHash("regex")),
+					"Asset name %s in OMF hint is not a valid regular expression, it will be treated as a literal asset name.", asset.c_str());
+				addExactHint(asset, hint);
+			}
+		}
+		else
+		{
+			addExactHint(asset, hint);
+		}
+	}
+	analyseRules(candidates);
+}
+
+/**
+ * Configure the schema hints. These are keyed by an asset name, or regular
+ * expression, and give an ordered list of rules. Each rule has a set of
+ * datapoint names and the hint to apply if all of those datapoints are
+ * present in the reading.
+ *
+ * @param schemaHints	The schema hints JSON document
+ */
+void
+OMFHintRuleSet::configureSchemaHints(const string& schemaHints)
+{
+	Document doc;
+	ParseResult result = doc.Parse(schemaHints.c_str());
+	if (!result || !doc.IsObject())
+	{
+		m_diagnostics->error(hintHash(schemaHints, hintHash("schemaHints")),
+			"Error parsing OMF schema hints, expected a JSON object");
+		return;
+	}
+	for (Value::ConstMemberIterator itr = doc.MemberBegin(); itr != doc.MemberEnd(); ++itr)
+	{
+		SchemaHint schema;
+		schema.asset = itr->name.GetString();
+		schema.isRegex = false;
+		if (IsRegex(schema.asset))
+		{
+			try {
+				schema.regex = std::regex(schema.asset, regexFlags());
+				schema.isRegex = true;
+			} catch (const std::regex_error& e) {
+				m_diagnostics->warn(hintHash(schema.asset, hintHash("schemaRegex")),
+					"Asset name %s in OMF schema hint is not a valid regular expression, it will be treated as a literal asset name.", schema.asset.c_str());
+			}
+		}
+		if (!schema.isRegex && m_caseInsensitive)
+			schema.asset = foldCase(schema.asset);
+		if (!itr->value.IsArray())
+		{
+			m_diagnostics->warn(hintHash(schema.asset, hintHash("schemaArray")),
+				"The OMF schema hints for %s should be an array of rules", schema.asset.c_str());
+			continue;
+		}
+		for (auto& item : itr->value.GetArray())
+		{
+			if (!item.IsObject() || !item.HasMember("datapoints") || !item["datapoints"].IsArray()
+					|| !item.HasMember("hint") || !item["hint"].IsObject())
+			{
+				m_diagnostics->warn(hintHash(schema.asset, hintHash("schemaRule")),
+					"Each OMF schema hint rule for %s should have a datapoints array and a hint object", schema.asset.c_str());
+				continue;
+			}
+			SchemaRule rule;
+			for (auto& dp : item["datapoints"].GetArray())
+			{
+				if (dp.IsString())
+					rule.datapoints.push_back(dp.GetString());
+			}
+			compileHint(item["hint"], rule.hint);
+			schema.rules.push_back(rule);
+		}
+		m_schemaHints.push_back(schema);
+	}
+}
+
+/**
+ * Add a hint for an exact asset name. If asset names are matched without
+ * regard to case the name is case folded.
+ *
+ * @param asset	The asset name
+ * @param hint	The hint
+ */
+void
+OMFHintRuleSet::addExactHint(const string& asset, const OMFHint& hint)
+{
+	string key = m_caseInsensitive ? foldCase(asset) : asset;
+	if (!m_hints.insert(pair<string, OMFHint>(key, hint)).second && m_caseInsensitive)
+	{
+		m_diagnostics->warn(hintHash(asset, hintHash("case")),
+				"The OMF hint for asset %s will not be used as there is an earlier hint for an asset name that differs only in case",
+				asset.c_str());
+	}
+}
+
+/**
+ * Return the hint for an exact asset name
+ *
+ * @param asset	The asset name, case folded if matching is case insensitive
+ * @return	The hint or NULL if there is no hint for the asset name
+ */
+const OMFHint *
+OMFHintRuleSet::exactHint(const string& asset) const
+{
+	auto it = m_hints.find(asset);
+	if (it != m_hints.end())
+		return &it->second;
+	return NULL;
+}
+
+/**
+ * Find the first wildcard rule that matches an asset name
+ *
+ * @param asset	The asset name, case folded if matching is case insensitive
+ * @return int	The index of the matching wildcard rule or -1 if none match
+ */
+int
+OMFHintRuleSet::matchWildcard(const string& asset) const
+{
+	for (size_t i = 0; i < m_wildcards.size(); i++)
+	{
+		if (std::regex_match(asset, m_wildcards[i].regex))
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * Find the schema hint for a reading. The first rule, for an asset name
+ * or regular expression that matches the asset, for which all of the
+ * datapoints are present in the reading gives the hint.
+ *
+ * @param reading	The reading
+ * @param asset		The asset name, case folded if matching is case insensitive
+ * @return		The hint or NULL if no schema hint applies
+ */
+const OMFHint *
+OMFHintRuleSet::matchSchema(Reading *reading, const string& asset) const
+{
+	for (auto& schema : m_schemaHints)
+	{
+		if (schema.isRegex ? !std::regex_match(asset, schema.regex) : schema.asset != asset)
+			continue;
+		for (auto& rule : schema.rules)
+		{
+			bool present = true;
+			for (auto& name : rule.datapoints)
+			{
+				if (!reading->getDatapoint(name))
+				{
+					present = false;
+					break;
+				}
+			}
+			if (present)
+				return &rule.hint;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Fold the case of an asset name for case insensitive matching
+ *
+ * @param str		The asset name
+ * @return string	The lower case asset name
+ */
+string
+OMFHintRuleSet::foldCase(const string& str)
+{
+	string folded = str;
+	for (auto& c : folded)
+		c = tolower((unsigned char)c);
+	return folded;
+}
+
+/**
+ * Approximate size in bytes of each state of a compiled regular expression.
+ * The standard library gives no access to the real size of a std::regex so
+ * the memory reported by the rule analysis is an estimate.
+ */
+#define REGEX_STATE_SIZE	64
+
+/**
+ * Number of times each probe asset name is matched when estimating the
+ * cost of a wildcard rule.
+ */
+#define COST_ITERATIONS		4
+
+/**
+ * Check if a regular expression can only ever match a single literal asset
+ * name, e.g. "Pump\.1", and if so return that literal.
+ *
+ * @param pattern	The regular expression
+ * @param literal	Returned literal asset name
+ * @return bool		True if the pattern is a literal
+ */
+static bool literalPattern(const string& pattern, string& literal)
+{
+	literal.clear();
+	for (size_t i = 0; i < pattern.length(); i++)
+	{
+		char c = pattern[i];
+		if (c == '^' && i == 0)
+			continue;
+		if (c == '$' && i == pattern.length() - 1)
+			continue;
+		if (c == '\\')
+		{
+			// An escaped character class such as \d is not a literal
+			if (i + 1 >= pattern.length() || isalnum(pattern[i + 1]))
+				return false;
+			literal += pattern[++i];
+			continue;
+		}
+		if (strchr(".[]{}()*+?|^$", c))
+			return false;
+		literal += c;
+	}
+	return true;
+}
+
+/**
+ * Check if a regular expression matches every asset name. Asset names
+ * never contain line terminators, so ".*" is treated as matching all.
+ *
+ * @param pattern	The regular expression
+ * @return bool		True if the pattern matches all asset names
+ */
+static bool matchesAll(const string& pattern)
+{
+	string p = pattern;
+	if (!p.empty() && p.front() == '^')
+		p.erase(0, 1);
+	if (!p.empty() && p.back() == '$')
+		p.pop_back();
+	if (p.length() > 2 && p.front() == '(' && p.back() == ')')
+		p = p.substr(1, p.length() - 2);
+	return p == ".*" || p == "[\\s\\S]*";
+}
+
+/**
+ * Estimate the cost of attempting a match of a wildcard rule by timing it
+ * against a set of probe asset names.
+ *
+ * @param regex		The compiled regular expression
+ * @param probes	The asset names to match
+ * @return double	Average nanoseconds per match attempt
+ */
+static double estimateMatchCost(const std::regex& regex, const vector<string>& probes)
+{
+	unsigned int matched = 0;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < COST_ITERATIONS; i++)
+	{
+		for (auto& probe : probes)
+		{
+			if (std::regex_match(probe, regex))
+				matched++;
+		}
+	}
+	double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	(void)matched;
+	return elapsed / (COST_ITERATIONS * probes.size());
+}
+
+/**
+ * Analyse the wildcard rules found in the hints, reporting the compile time,
+ * estimated match cost and memory of each rule. Rules that can never be
+ * applied, because they duplicate or are shadowed by an exact asset name or
+ * an earlier wildcard, are dropped from the set of rules tried for each
+ * reading. A wildcard that is a literal asset name and is not shadowed is
+ * moved to the exact asset names.
+ *
+ * A summary of the report is logged, the full JSON report is logged at
+ * debug level and may be retrieved with ruleReport().
+ *
+ * @param candidates	The wildcard rules in the order they appear in the hints
+ */
+void OMFHintRuleSet::analyseRules(vector<WildcardRule>& candidates)
+{
+	Logger *logger = Logger::getLogger();
+	vector<string> probes;
+	for (auto& hint : m_hints)
+	{
+		if (probes.size() >= 8)
+			break;
+		probes.push_back(hint.first);
+	}
+	probes.push_back(string(32, 'x'));
+
+	size_t memory = 0;
+	for (auto& hint : m_hints)
+	{
+		memory += sizeof(pair<const string, OMFHint>) + hint.first.capacity()
+				+ hint.second.json.capacity();
+	}
+
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("rules");
+	writer.StartArray();
+
+	unsigned int unreachable = 0, promoted = 0;
+	set<string> patterns;
+	for (auto& rule : candidates)
+	{
+		string status = "active";
+		string shadowedBy;
+		string literal;
+		if (patterns.find(rule.pattern) != patterns.end())
+		{
+			status = "duplicate";
+			shadowedBy = rule.pattern;
+		}
+		else
+		{
+			for (auto& earlier : m_wildcards)
+			{
+				if (matchesAll(earlier.pattern))
+				{
+					status = "shadowed";
+					shadowedBy = earlier.pattern;
+					break;
+				}
+			}
+		}
+		if (status == "active" && literalPattern(rule.pattern, literal))
+		{
+			if (m_caseInsensitive)
+				literal = foldCase(literal);
+			if (m_hints.find(literal) != m_hints.end())
+			{
+				status = "shadowed";
+				shadowedBy = literal;
+			}
+			else
+			{
+				for (auto& earlier : m_wildcards)
+				{
+					if (std::regex_match(literal, earlier.regex))
+					{
+						status = "shadowed";
+						shadowedBy = earlier.pattern;
+						break;
+					}
+				}
+			}
+			if (status == "active")
+				status = "promoted";
+		}
+		patterns.insert(rule.pattern);
+
+		rule.matchCost = estimateMatchCost(rule.regex, probes);
+		writer.StartObject();
+		writer.Key("pattern");
+		writer.String(rule.pattern.c_str());
+		writer.Key("status");
+		writer.String(status.c_str());
+		if (!shadowedBy.empty())
+		{
+			writer.Key("shadowedBy");
+			writer.String(shadowedBy.c_str());
+		}
+		writer.Key("compileTime");
+		writer.Double(rule.compileTime);
+		writer.Key("matchCost");
+		writer.Double(rule.matchCost);
+		writer.EndObject();
+
+		if (status == "active")
+		{
+			logger->debug("OMF hint pattern %s compiled in %.1fuS, estimated match cost %.0fnS",
+					rule.pattern.c_str(), rule.compileTime, rule.matchCost);
+			memory += sizeof(WildcardRule) + rule.pattern.capacity() + rule.hint.json.capacity()
+					+ rule.pattern.length() * REGEX_STATE_SIZE;
+			m_wildcards.push_back(rule);
+		}
+		else if (status == "promoted")
+		{
+			logger->info("OMF hint pattern %s matches only the asset %s and will be treated as an asset name",
+					rule.pattern.c_str(), literal.c_str());
+			memory += sizeof(pair<const string, OMFHint>) + literal.capacity()
+					+ rule.hint.json.capacity();
+			m_hints.insert(pair<string, OMFHint>(literal, rule.hint));
+			promoted++;
+		}
+		else
+		{
+			m_diagnostics->warn(hintHash(rule.pattern, hintHash("unreachable")),
+					"OMF hint for asset pattern %s will never be applied as it %s %s, it has been removed",
+					rule.pattern.c_str(),
+					status == "duplicate" ? "duplicates the earlier pattern" : "is shadowed by",
+					shadowedBy.c_str());
+			unreachable++;
+		}
+	}
+	writer.EndArray();
+	writer.Key("exact");
+	writer.Uint(m_hints.size());
+	writer.Key("wildcards");
+	writer.Uint(m_wildcards.size());
+	writer.Key("promoted");
+	writer.Uint(promoted);
+	writer.Key("unreachable");
+	writer.Uint(unreachable);
+	writer.Key("memory");
+	writer.Uint64(memory);
+	writer.EndObject();
+	m_ruleReport = buffer.GetString();
+	logger->debug("OMF hint rule report: %s", m_ruleReport.c_str());
+
+	logger->info("OMF hint rules: %lu asset names, %lu patterns, %u patterns removed as unreachable, approximately %lu bytes",
+			m_hints.size(), m_wildcards.size(), unreachable, memory);
+}
+
+/**
+ * Compile a hint from the configuration. A hint with a variants member has
+ * a variant for each of the given values of a datapoint. The members given
+ * for each value are merged with the other members of the hint and the
+ * variants are prepared in the same way as any other hint.
+ *
+ * @param value	The hint JSON value
+ * @param hint	The compiled hint
+ */
+void OMFHintRuleSet::compileHint(const Value& value, OMFHint& hint)
+{
+	if (!value.IsObject() || !value.HasMember("variants"))
+	{
+		prepareHint(value, hint);
+		return;
+	}
+
+	// The hint without the variants is the base of each variant
+	Document base;
+	base.SetObject();
+	for (Value::ConstMemberIterator itr = value.MemberBegin(); itr != value.MemberEnd(); ++itr)
+	{
+		if (strcmp(itr->name.GetString(), "variants") == 0)
+			continue;
+		Value name(itr->name, base.GetAllocator());
+		Value member(itr->value, base.GetAllocator());
+		base.AddMember(name, member, base.GetAllocator());
+	}
+	prepareHint(base, hint);
+
+	const Value& variants = value["variants"];
+	if (!variants.IsObject() || !variants.HasMember("datapoint") || !variants["datapoint"].IsString()
+			|| !variants.HasMember("values") || !variants["values"].IsObject())
+	{
+		m_diagnostics->warn(hintHash(hint.json, hintHash("variants")),
+				"The variants of an OMF hint should have a datapoint name and an object of values, the variants will be ignored");
+		return;
+	}
+
+	shared_ptr<HintVariants> table = make_shared<HintVariants>();
+	table->datapoint = variants["datapoint"].GetString();
+	table->hasDefault = base.MemberCount() > 0;
+	const Value& values = variants["values"];
+	for (Value::ConstMemberIterator itr = values.MemberBegin(); itr != values.MemberEnd(); ++itr)
+	{
+		if (!itr->value.IsObject())
+		{
+			m_diagnostics->warn(hintHash(itr->name.GetString(), hintHash(table->datapoint, hintHash("variant"))),
+					"The OMF hint variant for %s value %s should be an object",
+					table->datapoint.c_str(), itr->name.GetString());
+			continue;
+		}
+		Document merged;
+		merged.CopyFrom(base, merged.GetAllocator());
+		for (Value::ConstMemberIterator m = itr->value.MemberBegin(); m != itr->value.MemberEnd(); ++m)
+		{
+			Value member(m->value, merged.GetAllocator());
+			Value::MemberIterator existing = merged.FindMember(m->name.GetString());
+			if (existing != merged.MemberEnd())
+			{
+				existing->value = member;
+			}
+			else
+			{
+				Value name(m->name, merged.GetAllocator());
+				merged.AddMember(name, member, merged.GetAllocator());
+			}
+		}
+		OMFHint variant;
+		prepareHint(merged, variant);
+		table->values.insert(pair<string, OMFHint>(itr->name.GetString(), variant));
+	}
+	hint.variants = table;
+}
+
+/**
+ * Prepare a hint to be added to readings. If datapoint hints are pruned
+ * the datapoint hint entries are also compiled to separate fragments.
+ *
+ * @param value	The hint JSON value
+ * @param hint	The OMF hint
+ */
+void OMFHintRuleSet::prepareHint(const Value& value, OMFHint& hint)
+{
+	hint.json = escapeHint(value);
+	prepareHint(hint);
+	if (m_prune && hint.macros.empty())
+		preparePruned(value, hint);
+}
+
+/**
+ * Compile the fragments used to build a hint that contains only the
+ * datapoint hint entries for the datapoints in a reading. The fragment for
+ * each entry is escaped JSON, so building the pruned hint only requires
+ * the fragments to be concatenated.
+ *
+ * @param value	The hint JSON value
+ * @param hint	The OMF hint
+ */
+void OMFHintRuleSet::preparePruned(const Value& value, OMFHint& hint)
+{
+	if (!value.IsObject() || !value.HasMember("datapoint"))
+		return;
+	const Value& datapoints = value["datapoint"];
+
+	shared_ptr<PrunedHint> pruned = make_shared<PrunedHint>();
+	Document base;
+	base.SetObject();
+	for (Value::ConstMemberIterator itr = value.MemberBegin(); itr != value.MemberEnd(); ++itr)
+	{
+		if (strcmp(itr->name.GetString(), "datapoint") == 0)
+			continue;
+		Value name(itr->name, base.GetAllocator());
+		Value member(itr->value, base.GetAllocator());
+		base.AddMember(name, member, base.GetAllocator());
+	}
+	pruned->base = escapeHint(base);
+	pruned->open = pruned->base.substr(0, pruned->base.length() - 1)
+			+ (base.MemberCount() > 0 ? "," : "") + "\\\"datapoint\\\":[";
+
+	const Value *begin = &datapoints, *end = &datapoints + 1;
+	if (datapoints.IsArray())
+	{
+		begin = datapoints.Begin();
+		end = datapoints.End();
+	}
+	for (const Value *dp = begin; dp != end; ++dp)
+	{
+		if (!dp->IsObject() || !dp->HasMember("name") || !(*dp)["name"].IsString())
+		{
+			// Without a name the entry cannot be matched to a datapoint
+			return;
+		}
+		pruned->fragments.insert(pair<string, string>((*dp)["name"].GetString(), escapeHint(*dp)));
+	}
+	hint.pruned = pruned;
+}
+
+/**
+ * Prepare a hint to be added to readings. Find the macros within the hint
+ * or, if there are none, create the datapoint value that will be copied
+ * into each reading.
+ *
+ * @param hint	The OMF hint
+ */
+void OMFHintRuleSet::prepareHint(OMFHint& hint)
+{
+	// Check if macro substitution is required
+	// At least one pair of '$' sign must be there to apply macro
+	if (std::count(hint.json.begin(), hint.json.end(), '$') > 1)
+		collectMacrosInfo(hint);
+	if (hint.macros.empty())
+	{
+		vector<uint8_t> packed;
+		if (m_format == HINT_FORMAT_MSGPACK && HintCodec::encode(hint.json, packed))
+			hint.value = shared_ptr<DatapointValue>(HintCodec::toDatapointValue(packed));
+		else
+			hint.value = make_shared<DatapointValue>(hint.json);
+		hint.id = make_shared<DatapointValue>(hintId(hint.json));
+	}
+}
+
+/**
+ * Extract datapoint name for macro replacement. A macro name containing
+ * '.' characters may refer to a datapoint nested within a dictionary or
+ * list datapoint, the path to that datapoint is split into its elements
+ * here so that no parsing is needed for each reading.
+ *
+ * @param hint	The OMF hint
+ */
+void OMFHintRuleSet::collectMacrosInfo(OMFHint& hint)
+{
+	const std::string& hintsJSON = hint.json;
+	std::string::size_type start = hintsJSON.find('$');
+	std::string::size_type end = hintsJSON.find('$', start + 1);
+
+	while (start != std::string::npos && end != std::string::npos) 
+	{
+		if (end > start + 1) 
+		{
+			HintMacro macro;
+			macro.name = hintsJSON.substr(start + 1, end - start - 1);
+			macro.position = start;
+			macro.type = MACRO_DATAPOINT;
+			if (macro.name == "ASSET")
+				macro.type = MACRO_ASSET;
+			else if (macro.name == "TIMESTAMP")
+				macro.type = MACRO_TIMESTAMP;
+			else if (macro.name == "DATE")
+				macro.type = MACRO_DATE;
+			else if (macro.name == "USER_TS")
+				macro.type = MACRO_USER_TS;
+			else if (macro.name == "USER_DATE")
+				macro.type = MACRO_USER_DATE;
+			if (macro.name.find('.') != std::string::npos)
+			{
+				std::string::size_type elemStart = 0, elemEnd;
+				do {
+					elemEnd = macro.name.find('.', elemStart);
+					MacroPathElement element;
+					element.name = macro.name.substr(elemStart,
+							elemEnd == std::string::npos ? std::string::npos : elemEnd - elemStart);
+					char *endp;
+					long index = strtol(element.name.c_str(), &endp, 10);
+					element.index = (!element.name.empty() && *endp == 0 && index >= 0) ? index : -1;
+					macro.path.push_back(element);
+					elemStart = elemEnd + 1;
+				} while (elemEnd != std::string::npos);
+			}
+			hint.macros.push_back(macro);
+		}
+		start = hintsJSON.find('$', end + 1);
+		end = hintsJSON.find('$', start + 1);
+	}
+}
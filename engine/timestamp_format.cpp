@@ -0,0 +1,81 @@
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <timestamp_format.h>
+#include <time.h>
+
+#define SECONDS_PER_DAY	86400
+
+/**
+ * Length of the date and time up to, but not including, the
+ * fractional seconds. YYYY-MM-DD HH:MM:SS
+ */
+#define DATE_TIME_LEN	19
+
+using namespace std;
+
+/**
+ * Constructor for the timestamp formatter
+ */
+TimestampFormat::TimestampFormat() : m_second(-1), m_day(-1)
+{
+}
+
+/**
+ * Return a timestamp formatted as YYYY-MM-DD HH:MM:SS.uuuuuu. The date and
+ * time are only formatted when the second changes, the microseconds are
+ * then written into the cached string.
+ *
+ * @param tv	The timestamp
+ * @return	The formatted timestamp
+ */
+const string&
+TimestampFormat::dateTime(const struct timeval& tv)
+{
+	if (tv.tv_sec != m_second)
+	{
+		struct tm tm;
+		char buf[DATE_TIME_LEN + 1];
+		gmtime_r(&tv.tv_sec, &tm);
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+		m_dateTime = buf;
+		m_dateTime += ".000000";
+		m_second = tv.tv_sec;
+	}
+	long usec = tv.tv_usec;
+	for (int i = DATE_TIME_LEN + 6; i > DATE_TIME_LEN; i--)
+	{
+		m_dateTime[i] = '0' + usec % 10;
+		usec /= 10;
+	}
+	return m_dateTime;
+}
+
+/**
+ * Return the date of a timestamp formatted as YYYY-MM-DD. The date is
+ * only formatted when the day changes.
+ *
+ * @param seconds	The timestamp in seconds since the epoch
+ * @return		The formatted date
+ */
+const string&
+TimestampFormat::date(time_t seconds)
+{
+	time_t day = seconds / SECONDS_PER_DAY;
+	if (day != m_day)
+	{
+		struct tm tm;
+		char buf[11];
+		gmtime_r(&seconds, &tm);
+		strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+		m_date = buf;
+		m_day = day;
+	}
+	return m_date;
+}
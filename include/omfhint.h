@@ -11,8 +11,11 @@
 #include <reading_set.h>
 #include <config_category.h>
 #include <string>
-#include <map>
-#include <regex>
+#include <memory>
+#include <mutex>
+#include <asset_tracking.h>
+#include <omfhint_engine.h>
+#include <omfhint_pipeline.h>
 
 class OMFHintFilter : public FledgeFilter {
 	public:
@@ -20,14 +23,27 @@ class OMFHintFilter : public FledgeFilter {
 			ConfigCategory& filterConfig,
 			OUTPUT_HANDLE *outHandle,
 			OUTPUT_STREAM out);
+		void	ingest(READINGSET *readingSet);
 		void	ingest(std::vector<Reading *> *in, std::vector<Reading *>& out);
 		void	reconfigure(const std::string& newConfig);
+		void	shutdown();
 	private:
 		void	configure(const ConfigCategory& config);
-		void	collectMacrosInfo(std::string hintsJSON);
-		void	ReplaceMacros(Reading * reading, std::string& hintsJSON);
+		void	traceReading(Reading *reading, AssetTracker *instance);
 
-		std::map<std::string, std::string>               m_hints;
-		std::vector<std::pair<std::string, int>>         m_macro_dp;
-		std::vector<std::pair<std::regex, std::string>> m_wildcards;
+		OMFHintEngine                                    m_engine;
+		bool                                             m_persist;
+		unsigned int                                     m_persistInterval;
+		std::string                                      m_cachePath;
+		time_t                                           m_lastPersist;
+		unsigned long                                    m_chunkSize;
+		bool                                             m_decode;
+		bool                                             m_pipelined;
+		unsigned int                                     m_queueDepth;
+		std::string                                      m_tracePath;
+		unsigned long                                    m_traceRate;
+		std::unique_ptr<HintTracer>                      m_tracer;
+		std::mutex                                       m_configMutex;
+		// Declared last so the pipeline thread stops before the state it uses is destroyed
+		std::shared_ptr<OMFHintPipeline>                 m_pipeline;
 };
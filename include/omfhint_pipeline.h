@@ -0,0 +1,58 @@
+#ifndef _OMFHINT_PIPELINE_H
+#define _OMFHINT_PIPELINE_H
+/*
+ * Fledge OMFHint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <plugin_api.h>
+#include <reading.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class OMFHintFilter;
+
+/**
+ * Pipelined processing of the chunks of a reading set. A render thread
+ * adds the hints to the next chunks of the set while the caller of
+ * plugin_ingest forwards the chunks that are complete. Every chunk is
+ * forwarded on the caller's thread, in order, before process() returns,
+ * so the filter remains synchronous as far as the rest of the filter
+ * pipeline is concerned. The queue depth limits the number of chunks
+ * rendered ahead of the chunk being forwarded.
+ */
+class OMFHintPipeline {
+	public:
+		OMFHintPipeline(OMFHintFilter *filter, unsigned int depth);
+		~OMFHintPipeline();
+		void		process(std::vector<Reading *> *readings, size_t chunkSize,
+					OUTPUT_STREAM output, OUTPUT_HANDLE *handle);
+	private:
+		/**
+		 * A chunk of readings queued for the render thread
+		 */
+		struct Chunk {
+			std::vector<Reading *>	in;
+			std::vector<Reading *>	out;
+			bool			done;
+		};
+		void		submit(Chunk& chunk);
+		void		renderLoop();
+
+		OMFHintFilter			*m_filter;
+		unsigned int			m_depth;
+		std::mutex			m_mutex;
+		std::condition_variable		m_queueCV;
+		std::condition_variable		m_doneCV;
+		std::deque<Chunk *>		m_queue;
+		bool				m_stopping;
+		std::thread			m_renderThread;
+};
+#endif
@@ -10,17 +10,18 @@
 #include <stdio.h>
 #include <reading.h>
 #include <reading_set.h>
-#include <utility>
+#include <algorithm>
 #include <logger.h>
-#include <rapidjson/document.h>
-#include "rapidjson/stringbuffer.h"
-#include <rapidjson/writer.h>
 #include <omfhint.h>
-#include <string_utils.h>
-#include <string.h>
+#include <time.h>
 
 using namespace std;
-using namespace rapidjson;
+
+/**
+ * The asset tracking event recorded for assets that have hints added,
+ * built once rather than for every reading
+ */
+static const string trackingEvent("Filter");
 
 /**
  * Constructor for the OMFHint Filter class
@@ -31,12 +32,124 @@ OMFHintFilter::OMFHintFilter(const std::string& filterName,
 		     OUTPUT_HANDLE *outHandle,
 		     OUTPUT_STREAM out) :
 				FledgeFilter(filterName, filterConfig,
-						outHandle, out)
+						outHandle, out),
+				m_persist(false),
+				m_persistInterval(0),
+				m_lastPersist(time(0)),
+				m_chunkSize(0),
+				m_decode(false),
+				m_pipelined(false),
+				m_queueDepth(2),
+				m_traceRate(0)
 {
+	string dataDir;
+	const char *data = getenv("FLEDGE_DATA");
+	if (data)
+	{
+		dataDir = data;
+	}
+	else
+	{
+		const char *root = getenv("FLEDGE_ROOT");
+		dataDir = string(root ? root : "/usr/local/fledge") + "/data";
+	}
+	m_cachePath = dataDir + "/omfhint/" + filterConfig.getName() + ".cache";
+	m_tracePath = dataDir + "/omfhint/" + filterConfig.getName() + ".trace.json";
+
 	configure(filterConfig);
+	if (m_persist)
+		m_engine.loadCache(m_cachePath);
+	if (m_pipelined)
+		m_pipeline = make_shared<OMFHintPipeline>(this, m_queueDepth);
+}
+
+/**
+ * Called when the plugin is shutdown, write the rule cache if persistence
+ * is enabled.
+ */
+void
+OMFHintFilter::shutdown()
+{
+	shared_ptr<OMFHintPipeline> pipeline;
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		pipeline.swap(m_pipeline);
+	}
+	// Stop the render thread without holding the lock it renders with
+	pipeline.reset();
+
+	lock_guard<mutex> guard(m_configMutex);
+	if (m_persist && m_engine.cacheDirty())
+		m_engine.saveCache(m_cachePath);
 }
 
+/**
+ * Ingest a set of readings. The hints are added and the readings passed
+ * downstream before returning. Large sets are processed in chunks if a
+ * chunk size is configured, each chunk is passed downstream as soon as it
+ * is complete. In pipelined mode the later chunks are rendered by the
+ * pipeline thread while the earlier chunks are forwarded.
+ *
+ * The configuration lock is only held while the hints are added, not
+ * while the readings are forwarded, so a slow downstream filter does not
+ * hold up a reconfiguration.
+ *
+ * @param readingSet	The readings to process
+ */
+void
+OMFHintFilter::ingest(READINGSET *readingSet)
+{
+	if (!isEnabled())
+	{
+		// Current filter is not active: just pass the readings set
+		m_func(m_data, readingSet);
+		return;
+	}
+
+	size_t chunkSize;
+	shared_ptr<OMFHintPipeline> pipeline;
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		chunkSize = m_chunkSize;
+		pipeline = m_pipeline;
+	}
+
+	vector<Reading *> *readings = readingSet->getAllReadingsPtr();
+	if (chunkSize == 0 || readings->size() <= chunkSize)
+	{
+		vector<Reading *>out;
+		ingest(readings, out);
+		delete (ReadingSet *)readingSet;
 
+		ReadingSet *newReadingSet = new ReadingSet(&out);
+		m_func(m_data, newReadingSet);
+		return;
+	}
+
+	if (pipeline)
+	{
+		pipeline->process(readings, chunkSize, m_func, m_data);
+		delete (ReadingSet *)readingSet;
+		return;
+	}
+
+	// Stream the readings downstream a chunk at a time
+	vector<Reading *> in, out;
+	in.reserve(chunkSize);
+	out.reserve(chunkSize);
+	for (size_t offset = 0; offset < readings->size(); offset += chunkSize)
+	{
+		size_t end = min(offset + chunkSize, readings->size());
+		in.assign(readings->begin() + offset, readings->begin() + end);
+		ingest(&in, out);
+
+		ReadingSet *chunk = new ReadingSet(&out);
+		out.clear();
+		m_func(m_data, chunk);
+	}
+	readings->clear();
+	delete (ReadingSet *)readingSet;
+}
 
 /**
  * Ingest data into the plugin and write the processed data to the out vector
@@ -47,191 +160,158 @@ OMFHintFilter::OMFHintFilter(const std::string& filterName,
 void
 OMFHintFilter::ingest(vector<Reading *> *readings, vector<Reading *>& out)
 {
+	lock_guard<mutex> guard(m_configMutex);
 	AssetTracker *instance =  nullptr;
 	instance =  AssetTracker::getAssetTracker();
+	out.reserve(out.size() + readings->size());
 	// Iterate thru' the readings
  	for (vector<Reading *>::const_iterator elem = readings->begin();
 			elem != readings->end(); ++elem)
 	{
-		string name = (*elem)->getAssetName();
-		auto it = m_hints.find(name);
-
-		if (it != m_hints.end())
+		if (m_tracer && m_tracer->sample())
 		{
-			std::string hintsJSON = it->second;
-			if (!m_macro_dp.empty())
-				ReplaceMacros(*elem, hintsJSON);
-			DatapointValue value(hintsJSON);
-			(*elem)->addDatapoint(new Datapoint("OMFHint", value));
-			if (instance != nullptr)
-			{
-				instance->addAssetTrackingTuple(m_name, name, string("Filter"));
-			}
-		} else {
-
-			if ( ! m_wildcards.empty() ) {
-
-				for(auto &item : m_wildcards) {
-
-					if (std::regex_match (name, item.first))
-					{
-						std::string hintsJSON = item.second;
-						if (!m_macro_dp.empty())
-							ReplaceMacros(*elem, hintsJSON);
-						DatapointValue value(hintsJSON);
-						(*elem)->addDatapoint(new Datapoint("OMFHint", value));
-						if (instance != nullptr)
-						{
-							instance->addAssetTrackingTuple(m_name, name, string("Filter"));
-						}
-						break;
-					}
-				}
-			}
+			traceReading(*elem, instance);
+		}
+		else
+		{
+			if (m_decode)
+				m_engine.decode(*elem);
+			if (m_engine.apply(*elem) && instance != nullptr)
+				instance->addAssetTrackingTuple(m_name, (*elem)->getAssetName(), trackingEvent);
 		}
 		out.push_back(*elem);
 	}
 	readings->clear();
-}
 
+	// Log the counts of repeated warnings once the interval has passed
+	m_engine.poll();
+
+	if (m_persist && m_engine.cacheDirty() && m_persistInterval
+			&& time(0) - m_lastPersist >= m_persistInterval)
+	{
+		m_lastPersist = time(0);
+		m_engine.saveCache(m_cachePath);
+	}
+}
 
 /**
- * Reconfigure the RMS filter
+ * Add the hint to a sampled reading, writing the time taken by each stage
+ * to the trace file
  *
- * @param newConfig	The new configuration
+ * @param reading	The reading
+ * @param instance	The asset tracker
  */
 void
-OMFHintFilter::reconfigure(const string& newConfig)
+OMFHintFilter::traceReading(Reading *reading, AssetTracker *instance)
 {
-	setConfig(newConfig);
-	ConfigCategory config("config", newConfig);
-	configure(config);
+	ReadingTrace trace(*m_tracer, reading->getAssetName());
+	if (m_decode)
+	{
+		m_engine.decode(reading);
+		trace.mark("decode");
+	}
+	if (m_engine.apply(reading, trace) && instance != nullptr)
+	{
+		instance->addAssetTrackingTuple(m_name, reading->getAssetName(), trackingEvent);
+		trace.mark("asset tracking");
+	}
+	trace.finish();
 }
 
+/**
+ * Reconfigure the RMS filter
+ *
+ * @param newConfig	The new configuration
+ */
 void
-OMFHintFilter::configure(const ConfigCategory& config)
+OMFHintFilter::reconfigure(const string& newConfig)
 {
-	if (config.itemExists("hints"))
+	shared_ptr<OMFHintPipeline> previous;
 	{
-		m_hints.clear();
-		m_wildcards.clear();
+		lock_guard<mutex> guard(m_configMutex);
+		setConfig(newConfig);
+		ConfigCategory config("config", newConfig);
+		configure(config);
 
-		Document doc;
-		ParseResult result = doc.Parse(config.getValue("hints").c_str());
-		if (!result)
-		{
-			Logger::getLogger()->error("Error parsing OMF Hints: %s at %u",
-				doc.GetParseError(), result.Offset());
-		}
+		// Callers already using the previous pipeline finish with it
+		previous = m_pipeline;
+		if (m_pipelined)
+			m_pipeline = make_shared<OMFHintPipeline>(this, m_queueDepth);
 		else
-		{
-			for (Value::ConstMemberIterator itr = doc.MemberBegin(); itr != doc.MemberEnd(); ++itr)
-			{
-				string asset = itr->name.GetString();
-				StringBuffer buffer;
-				Writer<StringBuffer> writer(buffer);
-				itr->value.Accept(writer);
- 
-				const string hint = buffer.GetString();
-				string escaped = hint;
-				string replace = "\\\"";
-				size_t pos = escaped.find("\"");
-				while( pos != std::string::npos)
-				{
-					escaped.replace(pos, 1, replace);
-					pos = escaped.find("\"", pos+replace.size());
-				}
-
-				if (IsRegex(asset))
-				{
-					try {
-						m_wildcards.push_back(std::pair<std::regex, std::string>(std::regex(asset), escaped));
-					} catch (const std::regex_error& e) {
-						Logger::getLogger()->warn("Asset name %s in OMF hint is not a valid regular expression, it will be treated as a literal asset name.", asset.c_str());
-						m_hints.insert(pair<string, string>(asset, escaped));
-					}
-				}
-				else
-				{
-					m_hints.insert(pair<string, string>(asset, escaped));
-				}
-				// Check if macro substitution is required
-				// At least one pair of '$' sign must be there to apply macro
-				if (std::count(escaped.begin(), escaped.end(), '$') > 1)
-					collectMacrosInfo(escaped.c_str());
-			}
-		}
-	
+			m_pipeline.reset();
 	}
+	// The previous render thread is stopped here, without holding the lock
+	// it renders with, unless another caller is still using it
 }
 
-/**
- * Extract datapoint name for macro replacement
- *
- * @param hintsJson	OMFHints JSON
- */
-void OMFHintFilter::collectMacrosInfo(std::string hintsJSON)
+void
+OMFHintFilter::configure(const ConfigCategory& config)
 {
-	std::string::size_type start = hintsJSON.find('$');
-	std::string::size_type end = hintsJSON.find('$', start + 1);
+	if (config.itemExists("persistCache"))
+	{
+		m_persist = config.getValue("persistCache").compare("true") == 0;
+	}
+	if (config.itemExists("persistInterval"))
+	{
+		m_persistInterval = strtoul(config.getValue("persistInterval").c_str(), NULL, 10);
+	}
+	if (config.itemExists("chunkSize"))
+	{
+		m_chunkSize = strtoul(config.getValue("chunkSize").c_str(), NULL, 10);
+	}
+	bool hintId = false;
+	if (config.itemExists("hintId"))
+	{
+		hintId = config.getValue("hintId").compare("true") == 0;
+	}
+	HintFormat format = HINT_FORMAT_JSON;
+	if (config.itemExists("hintFormat"))
+	{
+		format = config.getValue("hintFormat").compare("MessagePack") == 0 ?
+				HINT_FORMAT_MSGPACK : HINT_FORMAT_JSON;
+	}
+	if (config.itemExists("decodeHints"))
+	{
+		m_decode = config.getValue("decodeHints").compare("true") == 0;
+	}
+	if (config.itemExists("pipelined"))
+	{
+		m_pipelined = config.getValue("pipelined").compare("true") == 0;
+	}
+	if (config.itemExists("queueDepth"))
+	{
+		m_queueDepth = strtoul(config.getValue("queueDepth").c_str(), NULL, 10);
+	}
 
-	while (start != std::string::npos && end != std::string::npos) 
+	unsigned long traceRate = 0;
+	if (config.itemExists("trace") && config.getValue("trace").compare("true") == 0)
 	{
-		if (end > start + 1) 
-		{
-			m_macro_dp.emplace_back(std::make_pair( hintsJSON.substr(start + 1, end - start - 1), start));
-		}
-		start = hintsJSON.find('$', end + 1);
-		end = hintsJSON.find('$', start + 1);
+		traceRate = 1;
+		if (config.itemExists("traceSampleRate"))
+			traceRate = max(1UL, strtoul(config.getValue("traceSampleRate").c_str(), NULL, 10));
+	}
+	if (traceRate != m_traceRate)
+	{
+		// Close the previous trace before the new one replaces its file
+		m_tracer.reset();
+		if (traceRate)
+			m_tracer.reset(new HintTracer(m_tracePath, traceRate));
+		m_traceRate = traceRate;
 	}
-}
 
-/**
- * Replace Macros with datapoint values
- *
- * @param reading	Reading
- * @param hintsJson	OMFHints JSON
- */
-void OMFHintFilter::ReplaceMacros(Reading *reading, std::string &hintsJSON)
-{
-	// Replace Macros by datapoint value
-	for (auto it =  m_macro_dp.rbegin(); it != m_macro_dp.rend(); ++it)
+	bool caseInsensitive = false;
+	if (config.itemExists("caseInsensitive"))
 	{
-		// In case of ASSET Macro, replace it by asset name instead of datapoint value
-		if ((*it).first == "ASSET")
-		{
-			hintsJSON.replace((*it).second, (*it).first.length()+2, reading->getAssetName() );
-			continue;
-		}
-		Datapoint * datapoint = reading->getDatapoint((*it).first);
+		caseInsensitive = config.getValue("caseInsensitive").compare("true") == 0;
+	}
+	string hints = config.itemExists("hints") ? config.getValue("hints") : "{}";
+	string schemaHints = config.itemExists("schemaHints") ? config.getValue("schemaHints") : "{}";
 
-		if (datapoint)
-		{
-			// Check for datapoint type for string and numbers
-			DatapointValue::dataTagType dataType = datapoint->getData().getType();
-			if (
-				dataType != DatapointValue::dataTagType::T_STRING &&
-				dataType != DatapointValue::dataTagType::T_INTEGER &&
-				dataType != DatapointValue::dataTagType::T_FLOAT
-			)
-			{
-				Logger::getLogger()->warn("The datapoint %s cannot be used as a macro substitution in the OMF Hint as it is not a string or numeric value",(*it).first.c_str());
-				continue;
-			}
-			string datapointValue = "";
-			switch (dataType)
-			{
-				case DatapointValue::dataTagType::T_INTEGER: 
-					datapointValue = std::to_string(datapoint->getData().toInt());
-					break;
-				case DatapointValue::dataTagType::T_FLOAT: 
-					datapointValue = std::to_string(datapoint->getData().toDouble());
-					break;
-				default: 
-				datapointValue = datapoint->getData().toStringValue();
-				break;
-			}
-			hintsJSON.replace((*it).second, (*it).first.length()+2, datapointValue );
-		}
+	bool prune = false;
+	if (config.itemExists("pruneDatapoints"))
+	{
+		prune = config.getValue("pruneDatapoints").compare("true") == 0;
 	}
+
+	m_engine.configure(hints, schemaHints, caseInsensitive, format, hintId, prune);
 }
@@ -0,0 +1,128 @@
+/*
+ * Fledge omfhint filter plugin.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <omfhint_pipeline.h>
+#include <omfhint.h>
+#include <reading_set.h>
+#include <logger.h>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Constructor for the pipeline, start the render thread
+ *
+ * @param filter	The filter that renders the readings
+ * @param depth		The maximum number of chunks rendered ahead
+ */
+OMFHintPipeline::OMFHintPipeline(OMFHintFilter *filter, unsigned int depth) :
+	m_filter(filter),
+	m_depth(depth > 0 ? depth : 1),
+	m_stopping(false)
+{
+	m_renderThread = thread(&OMFHintPipeline::renderLoop, this);
+	Logger::getLogger()->info("Pipelined ingest started with a queue depth of %u", m_depth);
+}
+
+/**
+ * Destructor for the pipeline, stop the render thread. The pipeline is
+ * only destroyed once no caller is processing readings with it, so the
+ * queue is empty.
+ */
+OMFHintPipeline::~OMFHintPipeline()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_stopping = true;
+		m_queueCV.notify_all();
+	}
+	m_renderThread.join();
+}
+
+/**
+ * Add the hints to a set of readings a chunk at a time and pass each chunk
+ * to the output stream. The next chunks are rendered by the render thread
+ * while the caller forwards the current chunk.
+ *
+ * @param readings	The readings to process, the vector is emptied
+ * @param chunkSize	The number of readings in each chunk
+ * @param output	The output stream to pass the processed readings to
+ * @param handle	The handle to pass to the output stream
+ */
+void
+OMFHintPipeline::process(vector<Reading *> *readings, size_t chunkSize,
+		OUTPUT_STREAM output, OUTPUT_HANDLE *handle)
+{
+	// The chunks of this set that have been queued and not yet forwarded
+	deque<Chunk> chunks;
+	size_t offset = 0;
+	while (offset < readings->size() || !chunks.empty())
+	{
+		// Keep the render thread busy while the current chunk is forwarded
+		while (offset < readings->size() && chunks.size() <= m_depth)
+		{
+			size_t end = min(offset + chunkSize, readings->size());
+			chunks.emplace_back();
+			chunks.back().in.assign(readings->begin() + offset, readings->begin() + end);
+			chunks.back().done = false;
+			submit(chunks.back());
+			offset = end;
+		}
+
+		Chunk& chunk = chunks.front();
+		{
+			unique_lock<mutex> lck(m_mutex);
+			m_doneCV.wait(lck, [&chunk]{ return chunk.done; });
+		}
+		ReadingSet *readingSet = new ReadingSet(&chunk.out);
+		chunks.pop_front();
+		output(handle, readingSet);
+	}
+	readings->clear();
+}
+
+/**
+ * Queue a chunk for the render thread
+ *
+ * @param chunk		The chunk to render
+ */
+void
+OMFHintPipeline::submit(Chunk& chunk)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_queue.push_back(&chunk);
+	m_queueCV.notify_all();
+}
+
+/**
+ * The render thread, add the hints to each queued chunk in turn. Exits
+ * once stopping and the queue is empty.
+ */
+void
+OMFHintPipeline::renderLoop()
+{
+	while (true)
+	{
+		Chunk *chunk;
+		{
+			unique_lock<mutex> lck(m_mutex);
+			m_queueCV.wait(lck, [this]{ return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty())
+				return;
+			chunk = m_queue.front();
+			m_queue.pop_front();
+		}
+		m_filter->ingest(&chunk->in, chunk->out);
+		{
+			lock_guard<mutex> guard(m_mutex);
+			chunk->done = true;
+			m_doneCV.notify_all();
+		}
+	}
+}
@@ -41,6 +41,104 @@ static const char *default_config = QUOTE({
 		"order" : "1",
 		"displayName" : "OMF Hint",
 		"default": HINTS
+		},
+	"persistCache" : {
+		"description" : "Persist the resolution of asset names to hints so that it is available immediately after a restart.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "3",
+		"displayName" : "Persist Rule Cache"
+		},
+	"persistInterval" : {
+		"description" : "The interval in seconds at which the rule cache is written. The cache is also written on shutdown.",
+		"type" : "integer",
+		"default" : "300",
+		"order" : "4",
+		"displayName" : "Persist Interval",
+		"validity" : "persistCache == \"true\""
+		},
+	"chunkSize" : {
+		"description" : "Process large sets of readings in chunks of this many readings, forwarding each chunk as soon as it is complete. A value of 0 processes the whole set before forwarding.",
+		"type" : "integer",
+		"default" : "0",
+		"order" : "5",
+		"displayName" : "Chunk Size",
+		"minimum" : "0"
+		},
+	"schemaHints" : {
+		"description" : "OMF hints selected by the set of datapoints in a reading. These take precedence over the OMF hints for the asset.",
+		"type" : "JSON",
+		"default" : "{}",
+		"order" : "6",
+		"displayName" : "Schema Hints"
+		},
+	"caseInsensitive" : {
+		"description" : "Match asset names to hints without regard to case.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "7",
+		"displayName" : "Case Insensitive"
+		},
+	"hintId" : {
+		"description" : "Add an OMFHintId datapoint containing a hash of the content of the hint, allowing consumers to cache parsed hints. The OMF north plugin sends this datapoint as data, only enable it if the consumer removes it.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "8",
+		"displayName" : "Add Hint ID"
+		},
+	"pipelined" : {
+		"description" : "Add the hints to the next chunks of readings on a separate thread while the current chunk is being forwarded. Requires a chunk size.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "9",
+		"displayName" : "Pipelined"
+		},
+	"queueDepth" : {
+		"description" : "The maximum number of chunks of readings that have hints added ahead of the chunk being forwarded, in pipelined mode.",
+		"type" : "integer",
+		"default" : "2",
+		"order" : "10",
+		"displayName" : "Queue Depth",
+		"minimum" : "1",
+		"validity" : "pipelined == \"true\""
+		},
+	"hintFormat" : {
+		"description" : "The form in which hints are added to readings. MessagePack is more compact and is intended for readings sent to another Fledge instance, which must convert the hints back to JSON.",
+		"type" : "enumeration",
+		"options" : [ "JSON", "MessagePack" ],
+		"default" : "JSON",
+		"order" : "11",
+		"displayName" : "Hint Format"
+		},
+	"decodeHints" : {
+		"description" : "Convert OMFHint datapoints in incoming readings that are encoded as MessagePack back to JSON.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "12",
+		"displayName" : "Decode Hints"
+		},
+	"trace" : {
+		"description" : "Write the time taken by each stage of adding hints to a sample of the readings to a trace file in the Fledge data directory.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "13",
+		"displayName" : "Trace"
+		},
+	"traceSampleRate" : {
+		"description" : "Trace one reading in every this many readings.",
+		"type" : "integer",
+		"default" : "100",
+		"order" : "14",
+		"displayName" : "Trace Sample Rate",
+		"minimum" : "1",
+		"validity" : "trace == \"true\""
+		},
+	"pruneDatapoints" : {
+		"description" : "Only include the datapoint hints for datapoints that are present in each reading.",
+		"type" : "boolean",
+		"default" : "false",
+		"order" : "15",
+		"displayName" : "Prune Datapoint Hints"
 		}
 	 });
 
@@ -110,18 +208,7 @@ void plugin_ingest(PLUGIN_HANDLE *handle,
 	OMFHintFilter *omfhint = (OMFHintFilter *)handle;
 	if (omfhint)
 	{
-		if (!omfhint->isEnabled())
-		{
-			// Current filter is not active: just pass the readings set
-			omfhint->m_func(omfhint->m_data, readingSet);
-			return;
-		}
-		vector<Reading *>out;
-		omfhint->ingest(readingSet->getAllReadingsPtr(), out);
-		delete (ReadingSet *)readingSet;
-
-		ReadingSet *newReadingSet = new ReadingSet(&out);
-		omfhint->m_func(omfhint->m_data, newReadingSet);
+		omfhint->ingest(readingSet);
 	}
 }
 /*
@@ -146,6 +233,7 @@ void plugin_shutdown(PLUGIN_HANDLE *handle)
 
 	if (omfhint)
 	{
+		omfhint->shutdown();
 		delete omfhint;
 	}
 }
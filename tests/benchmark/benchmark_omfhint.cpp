@@ -0,0 +1,356 @@
+/*
+ * Fledge OMFHint filter plugin benchmarks.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ */
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter.h>
+#include <reading.h>
+#include <reading_set.h>
+#include <hint_codec.h>
+#include <omfhint_engine.h>
+#include <logger.h>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace std;
+using namespace std::chrono;
+using namespace rapidjson;
+
+extern "C" {
+	PLUGIN_INFORMATION *plugin_info();
+	void plugin_ingest(void *handle, READINGSET *readingSet);
+	PLUGIN_HANDLE plugin_init(ConfigCategory *config,
+			OUTPUT_HANDLE *outHandle,
+			OUTPUT_STREAM output);
+	void plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+/**
+ * Timing information collected by the downstream handler
+ */
+struct Forwarded {
+	steady_clock::time_point	first;
+	unsigned long			count;
+	unsigned long			calls;
+};
+
+/**
+ * Downstream handler, records the time of the first forward and
+ * discards the readings as a downstream consumer would.
+ */
+static void Handler(void *handle, READINGSET *readings)
+{
+	Forwarded *forwarded = (Forwarded *)handle;
+	if (forwarded->calls++ == 0)
+		forwarded->first = steady_clock::now();
+	forwarded->count += readings->getAllReadings().size();
+	delete readings;
+}
+
+/**
+ * Create a configured instance of the filter
+ *
+ * @param hints		The OMF hints
+ * @param items		Additional configuration items to set
+ * @param forwarded	The downstream handler data
+ */
+static void *createFilter(const string& hints,
+		const vector<pair<string, string>>& items,
+		Forwarded *forwarded)
+{
+	PLUGIN_INFORMATION *info = plugin_info();
+	ConfigCategory config("omfhint", info->config);
+	config.setItemsValueFromDefault();
+	config.setValue("hints", hints);
+	config.setValue("enable", "true");
+	for (auto& item : items)
+		config.setValue(item.first, item.second);
+	return plugin_init(&config, forwarded, Handler);
+}
+
+/**
+ * Create a set of readings, each with a few numeric datapoints
+ *
+ * @param count		The number of readings
+ * @param asset		The asset name prefix
+ */
+static ReadingSet *createReadings(unsigned long count, const string& asset)
+{
+	vector<Reading *> readings;
+	readings.reserve(count);
+	for (unsigned long i = 0; i < count; i++)
+	{
+		vector<Datapoint *> values;
+		DatapointValue flow((double)i);
+		values.push_back(new Datapoint("flow", flow));
+		DatapointValue pressure((long)i);
+		values.push_back(new Datapoint("pressure", pressure));
+		readings.push_back(new Reading(asset + to_string(i % 16), values));
+	}
+	return new ReadingSet(&readings);
+}
+
+/**
+ * Ingest a batch of readings with a given chunk size, run in a child
+ * process so that the peak memory of each run is measured separately.
+ *
+ * @param readings	The number of readings in the batch
+ * @param chunkSize	The chunk size, 0 disables chunking
+ */
+static void chunkedIngest(unsigned long readings, unsigned long chunkSize)
+{
+	Forwarded forwarded = { steady_clock::now(), 0, 0 };
+	void *handle = createFilter("{ \"pump.*\" : { \"number\" : \"float32\" } }",
+			{ { "chunkSize", to_string(chunkSize) } }, &forwarded);
+	ReadingSet *set = createReadings(readings, "pump");
+
+	steady_clock::time_point start = steady_clock::now();
+	plugin_ingest(handle, (READINGSET *)set);
+	steady_clock::time_point end = steady_clock::now();
+
+	printf("%10lu %10lu %8lu %14.2f %12.2f",
+			readings, chunkSize, forwarded.calls,
+			duration<double, milli>(forwarded.first - start).count(),
+			duration<double, milli>(end - start).count());
+	fflush(stdout);
+	plugin_shutdown(handle);
+}
+
+/**
+ * Compare the time to first forward and peak memory of processing a large
+ * batch as a whole and in chunks.
+ */
+static void benchmarkChunking()
+{
+	const unsigned long readings = 100000;
+	const unsigned long chunks[] = { 0, 100, 1000, 10000 };
+
+	printf("\nStreaming chunked forwarding\n");
+	printf("%10s %10s %8s %14s %12s %12s\n", "Readings", "Chunk", "Forwards",
+			"First (mS)", "Total (mS)", "Peak (kB)");
+	for (auto chunk : chunks)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			chunkedIngest(readings, chunk);
+			exit(0);
+		}
+		int status;
+		struct rusage usage;
+		wait4(pid, &status, 0, &usage);
+		printf(" %12ld\n", usage.ru_maxrss);
+	}
+}
+
+/**
+ * Compare the size and encoding time of representative hints in the
+ * escaped JSON and MessagePack forms
+ */
+static void benchmarkHintFormat()
+{
+	const int iterations = 100000;
+	const char *hints[] = {
+		R"({"number":"float32"})",
+		R"({"typeName":"pump","AFLocation":"/UK/London/TowerBridge/Pump1"})",
+		R"({"datapoint":[{"name":"voltage","number":"float32","uom":"V"},{"name":"current","number":"float32","uom":"A","minimum":0,"maximum":100}]})",
+		R"({"typeName":"meter","tagName":"meter-1","AFLocation":"/site/meters","legacyType":"Meter","datapoint":{"name":"energy","integer":"uint64","uom":"kWh"}})"
+	};
+
+	printf("\nHint formats\n");
+	printf("%10s %10s %8s %14s %14s\n", "JSON (B)", "Packed (B)", "Saving",
+			"JSON (nS)", "Packed (nS)");
+	for (auto hint : hints)
+	{
+		Document doc;
+		doc.Parse(hint);
+
+		string escaped;
+		steady_clock::time_point start = steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			StringBuffer buffer;
+			Writer<StringBuffer> writer(buffer);
+			doc.Accept(writer);
+			escaped = HintCodec::escape(buffer.GetString());
+		}
+		double jsonTime = duration<double, nano>(steady_clock::now() - start).count() / iterations;
+
+		vector<uint8_t> packed;
+		start = steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			packed.clear();
+			HintCodec::encode(doc, packed);
+		}
+		double packedTime = duration<double, nano>(steady_clock::now() - start).count() / iterations;
+
+		printf("%10lu %10lu %7.1f%% %14.1f %14.1f\n", escaped.length(), packed.size(),
+				100.0 * (1.0 - (double)packed.size() / escaped.length()),
+				jsonTime, packedTime);
+	}
+}
+
+/**
+ * Measure the cost of resolving hints directly through the engine, without
+ * the filter wrapper or a running Fledge
+ */
+static void benchmarkEngine()
+{
+	const int iterations = 1000000;
+	OMFHintEngine engine;
+	engine.configure("{ \"motor1\" : { \"number\" : \"float32\" }, \"pump.*\" : { \"number\" : \"float64\" } }");
+	const char *assets[] = { "motor1", "pump1", "valve1" };
+
+	printf("\nEngine asset resolution\n");
+	printf("%10s %14s\n", "Asset", "Match (nS)");
+	for (auto asset : assets)
+	{
+		string name(asset);
+		const OMFHint *hint = NULL;
+		steady_clock::time_point start = steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+			hint = engine.match(name);
+		double matchTime = duration<double, nano>(steady_clock::now() - start).count() / iterations;
+		printf("%10s %14.1f%s\n", asset, matchTime, hint ? "" : " (no hint)");
+	}
+}
+
+/**
+ * Compare the size of the hint and the throughput of adding it with and
+ * without pruning, for a hint with 200 datapoint entries and readings that
+ * carry a few of those datapoints
+ */
+static void benchmarkPruning()
+{
+	const int channels = 200;
+	const int iterations = 100000;
+	string hints = "{ \"rack\" : { \"typeName\" : \"rack\", \"datapoint\" : [";
+	for (int i = 0; i < channels; i++)
+	{
+		hints += string(i ? "," : "") + "{ \"name\" : \"channel" + to_string(i)
+			+ "\", \"number\" : \"float32\", \"uom\" : \"V\" }";
+	}
+	hints += "] } }";
+
+	printf("\nDatapoint hint pruning, %d datapoint hints\n", channels);
+	printf("%10s %10s %12s %14s\n", "Datapoints", "Pruned", "Hint (B)", "Readings/S");
+	const int present[] = { 1, 4, 16 };
+	for (auto count : present)
+	{
+		for (int prune = 0; prune < 2; prune++)
+		{
+			OMFHintEngine engine;
+			engine.configure(hints, "{}", false, HINT_FORMAT_JSON, false, prune);
+
+			size_t size = 0;
+			steady_clock::time_point start = steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				long value = i;
+				DatapointValue dpv(value);
+				vector<Datapoint *> datapoints;
+				for (int c = 0; c < count; c++)
+					datapoints.push_back(new Datapoint("channel" + to_string(c * 7), dpv));
+				Reading reading("rack", datapoints);
+				engine.apply(&reading);
+				if (i == 0)
+					size = reading.getDatapoint("OMFHint")->getData().toStringValue().length();
+			}
+			double seconds = duration<double>(steady_clock::now() - start).count();
+			printf("%10d %10s %12lu %14.0f\n", count, prune ? "yes" : "no", size, iterations / seconds);
+		}
+	}
+}
+
+/**
+ * Add a hint with a macro to a reading as the filter did before repeated
+ * warnings were deduplicated. The hint is copied, the datapoint for the
+ * macro is checked and, if it cannot be substituted, a warning is logged
+ * for every reading.
+ *
+ * @param reading	The reading
+ * @param hint		The escaped hint
+ * @param macro		The name of the datapoint in the macro
+ */
+static void applyLoggingEveryWarning(Reading *reading, const string& hint, const string& macro)
+{
+	string json = hint;
+	Datapoint *datapoint = reading->getDatapoint(macro);
+	if (datapoint)
+	{
+		DatapointValue::dataTagType dataType = datapoint->getData().getType();
+		if (dataType != DatapointValue::dataTagType::T_STRING &&
+			dataType != DatapointValue::dataTagType::T_INTEGER &&
+			dataType != DatapointValue::dataTagType::T_FLOAT)
+		{
+			Logger::getLogger()->warn("The datapoint %s cannot be used as a macro substitution in the OMF Hint as it is not a string or numeric value",
+					macro.c_str());
+		}
+	}
+	DatapointValue value(json);
+	reading->addDatapoint(new Datapoint("OMFHint", value));
+}
+
+/**
+ * Measure the throughput of adding a hint with a macro that refers to a
+ * dictionary datapoint, which cannot be substituted, so every reading
+ * raises a warning. The same readings are processed with a warning logged
+ * for every reading, as before the warnings were deduplicated, and by the
+ * engine, which logs the warning once and counts the repeats.
+ */
+static void benchmarkMacroWarnings()
+{
+	const int iterations = 100000;
+	const string hint = "{\\\"AFLocation\\\":\\\"/Site/$location$\\\"}";
+
+	printf("\nMisconfigured macro\n");
+	printf("%14s %14s\n", "Warnings", "Readings/S");
+	for (int deduplicated = 0; deduplicated < 2; deduplicated++)
+	{
+		OMFHintEngine engine;
+		engine.configure("{ \"sensor\" : { \"AFLocation\" : \"/Site/$location$\" } }");
+
+		long value = 2;
+		DatapointValue dpv(value);
+		steady_clock::time_point start = steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			vector<Datapoint *> *members = new vector<Datapoint *>;
+			members->push_back(new Datapoint("building", dpv));
+			DatapointValue location(members, true);
+			Reading reading("sensor", new Datapoint("location", location));
+			if (deduplicated)
+				engine.apply(&reading);
+			else
+				applyLoggingEveryWarning(&reading, hint, "location");
+		}
+		double seconds = duration<double>(steady_clock::now() - start).count();
+		printf("%14s %14.0f\n", deduplicated ? "deduplicated" : "every reading", iterations / seconds);
+	}
+}
+
+int main()
+{
+	benchmarkChunking();
+	benchmarkHintFormat();
+	benchmarkEngine();
+	benchmarkPruning();
+	benchmarkMacroWarnings();
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Allocation tracking tests for the OMFHint filter. These are only built
+ * when the tests are configured with -DALLOCATION_TRACKING=ON, in which
+ * case the global operator new and operator delete are replaced with
+ * versions that count the allocations made while tracking is enabled.
+ *
+ * The number of allocations made by Fledge to create a datapoint depends
+ * on the version of Fledge, so the filter is compared with the cost of
+ * adding the same datapoint to the readings directly rather than with a
+ * fixed count.
+ */
+#ifdef ALLOCATION_TRACKING
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <reading.h>
+#include <omfhint.h>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string>
+
+using namespace std;
+
+extern "C"
+{
+    PLUGIN_INFORMATION *plugin_info();
+};
+
+static atomic<bool> tracking(false);
+static atomic<unsigned long> allocations(0);
+
+void *operator new(size_t size)
+{
+    if (tracking)
+        allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t&) noexcept
+{
+    if (tracking)
+        allocations++;
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+#define BATCH_SIZE	10000
+
+/**
+ * Create a batch of readings for an asset, each with a string and an
+ * integer datapoint.
+ */
+static void createBatch(vector<Reading *>& readings, const string& asset)
+{
+    for (int i = 0; i < BATCH_SIZE; i++)
+    {
+        vector<Datapoint *> values;
+        DatapointValue city(string("London"));
+        values.push_back(new Datapoint("city", city));
+        DatapointValue floor((long)i);
+        values.push_back(new Datapoint("floor", floor));
+        readings.push_back(new Reading(asset, values));
+    }
+}
+
+/**
+ * Ingest a batch of readings for an asset and return the number of heap
+ * allocations made per reading. A first batch is ingested to warm up the
+ * caches that are populated the first time an asset is seen.
+ */
+static double filterAllocations(const string& hints, const string& asset)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory config("omfhint", info->config);
+    config.setItemsValueFromDefault();
+    config.setValue("hints", hints);
+    config.setValue("enable", "true");
+    OMFHintFilter filter("omfhint", config, NULL, NULL);
+
+    vector<Reading *> readings, out;
+    createBatch(readings, asset);
+    filter.ingest(&readings, out);
+    for (auto reading : out)
+        delete reading;
+    out.clear();
+
+    createBatch(readings, asset);
+    out.reserve(BATCH_SIZE);
+    allocations = 0;
+    tracking = true;
+    filter.ingest(&readings, out);
+    tracking = false;
+    for (auto reading : out)
+        delete reading;
+
+    return (double)allocations / BATCH_SIZE;
+}
+
+/**
+ * Return the number of heap allocations per reading made by adding a
+ * prebuilt hint datapoint value to each reading, the least work any
+ * implementation of a static hint can do.
+ */
+static double staticHintAllocations()
+{
+    vector<Reading *> readings;
+    createBatch(readings, "Camera");
+    DatapointValue value(string("{\\\"AFLocation\\\":\\\"/UK/London/Plant1\\\"}"));
+
+    allocations = 0;
+    tracking = true;
+    for (auto reading : readings)
+        reading->addDatapoint(new Datapoint("OMFHint", value));
+    tracking = false;
+    for (auto reading : readings)
+        delete reading;
+
+    return (double)allocations / BATCH_SIZE;
+}
+
+/**
+ * Return the number of heap allocations per reading made by copying a
+ * hint string and creating a datapoint from the copy, the least work a
+ * hint that is built for each reading can do.
+ */
+static double builtHintAllocations()
+{
+    vector<Reading *> readings;
+    createBatch(readings, "Camera");
+    string hint("{\\\"AFLocation\\\":\\\"/UK/$city$/$floor$/$ASSET$\\\"}");
+
+    allocations = 0;
+    tracking = true;
+    for (auto reading : readings)
+    {
+        string json = hint;
+        DatapointValue value(json);
+        reading->addDatapoint(new Datapoint("OMFHint", value));
+    }
+    tracking = false;
+    for (auto reading : readings)
+        delete reading;
+
+    return (double)allocations / BATCH_SIZE;
+}
+
+// A static hint allocates nothing beyond the new datapoint and its value
+TEST(OMFHINT_ALLOCATIONS, StaticExactHint)
+{
+    double perReading = filterAllocations(
+            R"({ "Camera" : { "AFLocation" : "/UK/London/Plant1" } })", "Camera");
+    ASSERT_EQ(perReading, staticHintAllocations());
+}
+
+// Once the asset has been resolved a wildcard costs the same as an exact name
+TEST(OMFHINT_ALLOCATIONS, WildcardHint)
+{
+    double perReading = filterAllocations(
+            R"({ "Cam.*" : { "AFLocation" : "/UK/London/Plant1" } })", "Camera");
+    ASSERT_EQ(perReading, staticHintAllocations());
+}
+
+// A macro hint allows at most one reallocation while the macros are replaced
+TEST(OMFHINT_ALLOCATIONS, MacroHint)
+{
+    double perReading = filterAllocations(
+            R"({ "Camera" : { "AFLocation" : "/UK/$city$/$floor$/$ASSET$" } })", "Camera");
+    ASSERT_LE(perReading, builtHintAllocations() + 1.0);
+}
+
+// Readings without a hint are passed on without any allocation
+TEST(OMFHINT_ALLOCATIONS, NoMatch)
+{
+    double perReading = filterAllocations(
+            R"({ "Pump" : { "number" : "float32" }, "Motor.*" : { "number" : "float32" } })", "Camera");
+    ASSERT_EQ(perReading, 0.0);
+}
+#endif
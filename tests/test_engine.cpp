@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <omfhint_engine.h>
+#include <reading.h>
+#include <string>
+
+using namespace std;
+
+TEST(OMFHINT_ENGINE, MatchAsset)
+{
+    OMFHintEngine engine;
+    ASSERT_EQ(engine.match("motor1"), (const OMFHint *)NULL);
+
+    ASSERT_TRUE(engine.configure(R"({ "motor1" : { "number" : "float32" }, "pump.*" : { "number" : "float64" } })"));
+    const OMFHint *hint = engine.match("motor1");
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("float32"), string::npos);
+    hint = engine.match("pump7");
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("float64"), string::npos);
+    ASSERT_EQ(engine.match("valve1"), (const OMFHint *)NULL);
+
+    // The same configuration does not change the rules
+    ASSERT_FALSE(engine.configure(R"({ "motor1" : { "number" : "float32" }, "pump.*" : { "number" : "float64" } })"));
+}
+
+TEST(OMFHINT_ENGINE, MatchReading)
+{
+    OMFHintEngine engine;
+    engine.configure(R"({ "modbus.*" : { "typeName" : "generic" } })",
+            R"({ "modbus_1" : [ { "datapoints" : [ "flow" ], "hint" : { "typeName" : "pump" } } ] })");
+
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    Reading pump("modbus_1", new Datapoint("flow", dpv));
+    Reading meter("modbus_1", new Datapoint("voltage", dpv));
+
+    const OMFHint *hint = engine.match(&pump);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("pump"), string::npos);
+    hint = engine.match(&meter);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("generic"), string::npos);
+}
+
+TEST(OMFHINT_ENGINE, Render)
+{
+    OMFHintEngine engine;
+    engine.configure(R"({ "Camera" : { "AFLocation" : "/UK/$city$/$ASSET$" } })");
+
+    DatapointValue london(string("London"));
+    Reading camera("Camera", new Datapoint("city", london));
+    const OMFHint *hint = engine.match(&camera);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_FALSE(hint->value);
+
+    string json = hint->json;
+    engine.render(&camera, *hint, json);
+    ASSERT_NE(json.find("/UK/London/Camera"), string::npos);
+
+    ASSERT_TRUE(engine.apply(&camera));
+    Datapoint *dp = camera.getDatapoint("OMFHint");
+    ASSERT_NE(dp, (Datapoint *)NULL);
+    ASSERT_EQ(dp->getData().toStringValue(), json);
+}
+
+TEST(OMFHINT_ENGINE, Variants)
+{
+    OMFHintEngine engine;
+    engine.configure(R"({
+        "Meter.*" : {
+            "number" : "float32",
+            "variants" : {
+                "datapoint" : "range",
+                "values" : {
+                    "high" : { "uom" : "kV" },
+                    "low" : { "uom" : "V", "number" : "float64" },
+                    "3" : { "uom" : "mV" }
+                }
+            }
+        },
+        "Gauge" : {
+            "variants" : { "datapoint" : "mode", "values" : { "on" : { "uom" : "bar" } } }
+        }
+    })");
+
+    DatapointValue high(string("high"));
+    DatapointValue low(string("low"));
+    DatapointValue other(string("other"));
+    long three = 3;
+    DatapointValue numeric(three);
+    Reading highMeter("Meter1", new Datapoint("range", high));
+    Reading lowMeter("Meter1", new Datapoint("range", low));
+    Reading otherMeter("Meter1", new Datapoint("range", other));
+    Reading numericMeter("Meter1", new Datapoint("range", numeric));
+    Reading gauge("Gauge", new Datapoint("mode", other));
+
+    const OMFHint *hint = engine.match(&highMeter);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("kV"), string::npos);
+    ASSERT_NE(hint->json.find("float32"), string::npos);
+    ASSERT_TRUE(hint->value);
+
+    // Members of the variant replace those of the hint
+    hint = engine.match(&lowMeter);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("float64"), string::npos);
+    ASSERT_EQ(hint->json.find("float32"), string::npos);
+
+    hint = engine.match(&numericMeter);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_NE(hint->json.find("mV"), string::npos);
+
+    // No variant, the hint without variants is used
+    hint = engine.match(&otherMeter);
+    ASSERT_NE(hint, (const OMFHint *)NULL);
+    ASSERT_EQ(hint->json.find("uom"), string::npos);
+    ASSERT_EQ(hint->json.find("variants"), string::npos);
+
+    // A hint with only variants does not apply without a variant
+    ASSERT_EQ(engine.match(&gauge), (const OMFHint *)NULL);
+}
+
+TEST(OMFHINT_ENGINE, PruneDatapoints)
+{
+    OMFHintEngine engine;
+    engine.configure(R"({
+        "Rack" : {
+            "typeName" : "rack",
+            "datapoint" : [
+                { "name" : "ch1", "uom" : "V" },
+                { "name" : "ch2", "uom" : "A" },
+                { "name" : "ch3", "uom" : "W" }
+            ]
+        },
+        "Motor" : { "datapoint" : { "name" : "speed", "integer" : "uint16" } }
+    })", "{}", false, HINT_FORMAT_JSON, false, true);
+
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    vector<Datapoint *> datapoints;
+    datapoints.push_back(new Datapoint("ch3", dpv));
+    datapoints.push_back(new Datapoint("other", dpv));
+    Reading rack("Rack", datapoints);
+    Reading empty("Rack", new Datapoint("other", dpv));
+    Reading motor("Motor", new Datapoint("speed", dpv));
+
+    ASSERT_TRUE(engine.apply(&rack));
+    string json = rack.getDatapoint("OMFHint")->getData().toStringValue();
+    ASSERT_EQ(json, "{\\\"typeName\\\":\\\"rack\\\",\\\"datapoint\\\":[{\\\"name\\\":\\\"ch3\\\",\\\"uom\\\":\\\"W\\\"}]}");
+
+    // No datapoint hints apply, the rest of the hint is added
+    ASSERT_TRUE(engine.apply(&empty));
+    json = empty.getDatapoint("OMFHint")->getData().toStringValue();
+    ASSERT_EQ(json, "{\\\"typeName\\\":\\\"rack\\\"}");
+
+    ASSERT_TRUE(engine.apply(&motor));
+    json = motor.getDatapoint("OMFHint")->getData().toStringValue();
+    ASSERT_EQ(json, "{\\\"datapoint\\\":[{\\\"name\\\":\\\"speed\\\",\\\"integer\\\":\\\"uint16\\\"}]}");
+}
+
+TEST(OMFHINT_ENGINE, MacroDiagnostics)
+{
+    OMFHintEngine engine;
+    engine.configure(R"({ "Sensor" : { "AFLocation" : "/Site/$location$" } })");
+
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    for (int i = 0; i < 10; i++)
+    {
+        vector<Datapoint *> *members = new vector<Datapoint *>;
+        members->push_back(new Datapoint("building", dpv));
+        DatapointValue location(members, true);
+        Reading sensor("Sensor", new Datapoint("location", location));
+        ASSERT_TRUE(engine.apply(&sensor));
+    }
+
+    // The warning is logged once, the repeats are only counted
+    ASSERT_EQ(engine.diagnostics().suppressed(), 9UL);
+
+    // New rules forget the counts
+    engine.configure(R"({ "Sensor" : { "AFLocation" : "/Site" } })");
+    ASSERT_EQ(engine.diagnostics().suppressed(), 0UL);
+}
+
+TEST(OMFHINT_ENGINE, DiagnosticsSummary)
+{
+    HintDiagnostics diagnostics(0);
+    diagnostics.warn(1, "First warning");
+    diagnostics.warn(1, "First warning");
+    diagnostics.warn(2, "Second warning");
+    ASSERT_EQ(diagnostics.suppressed(), 1UL);
+
+    // The interval has passed, the summary is logged and the counts cleared
+    diagnostics.poll();
+    ASSERT_EQ(diagnostics.suppressed(), 0UL);
+
+    // A known warning is still only counted
+    diagnostics.warn(2, "Second warning");
+    ASSERT_EQ(diagnostics.suppressed(), 1UL);
+}
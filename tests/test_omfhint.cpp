@@ -8,6 +8,10 @@
 #include <rapidjson/document.h>
 #include <reading.h>
 #include <reading_set.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace rapidjson;
@@ -21,6 +25,7 @@ extern "C"
                               OUTPUT_HANDLE *outHandle,
                               OUTPUT_STREAM output);
     void plugin_shutdown(PLUGIN_HANDLE handle);
+    void plugin_reconfigure(PLUGIN_HANDLE handle, const string& newConfig);
     int called = 0;
 
     void Handler(void *handle, READINGSET *readings)
@@ -28,6 +33,29 @@ extern "C"
         called++;
         *(READINGSET **)handle = readings;
     }
+
+    void ChunkHandler(void *handle, READINGSET *readings)
+    {
+        vector<size_t> *chunks = (vector<size_t> *)handle;
+        chunks->push_back(readings->getAllReadings().size());
+        for (auto reading : readings->getAllReadings())
+        {
+            if (reading->getDatapoint("OMFHint") == NULL)
+                chunks->push_back(0);
+        }
+        delete readings;
+    }
+
+    void PipelineHandler(void *handle, READINGSET *readings)
+    {
+        vector<string> *assets = (vector<string> *)handle;
+        for (auto reading : readings->getAllReadings())
+        {
+            if (reading->getDatapoint("OMFHint") != NULL)
+                assets->push_back(reading->getAssetName());
+        }
+        delete readings;
+    }
 };
 
 TEST(OMFHINT, OmfHintDisabled)
@@ -591,3 +619,642 @@ TEST(OMFHINT, OmfHintUnspportedMacro)
     delete outReadings;
     plugin_shutdown(handle);
 }
+
+// Testing the rule analysis removes unreachable patterns
+TEST(OMFHINT, OmfHintRuleReport)
+{
+    const char *hintsJSON = R"({
+        "Pump.1" : { "number" : "float32" },
+        "Pump\\.1" : { "number" : "float64" },
+        "Motor.*" : { "number" : "float16" },
+        "Motor.*" : { "number" : "float64" },
+        "Fan\\.2" : { "integer" : "uint16" },
+        ".*" : { "integer" : "int32" },
+        "Valve.*" : { "integer" : "int16" }
+    })";
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    config->setValue("hints", hintsJSON);
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    readings->push_back(new Reading("Valve3", new Datapoint("test", dpv)));
+    readings->push_back(new Reading("Fan.2", new Datapoint("test", dpv)));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *> results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 2);
+    Datapoint *outdp = results[0]->getDatapoint("OMFHint");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_STREQ(outdp->getData().toString().c_str(), "\"{\\\"integer\\\":\\\"int32\\\"}\"");
+    outdp = results[1]->getDatapoint("OMFHint");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_STREQ(outdp->getData().toString().c_str(), "\"{\\\"integer\\\":\\\"uint16\\\"}\"");
+
+    delete config;
+    delete outReadings;
+    plugin_shutdown(handle);
+}
+
+// Testing the wildcard resolution cache is persisted on shutdown
+TEST(OMFHINT, OmfHintPersistCache)
+{
+    char dataDir[] = "/tmp/omfhintXXXXXX";
+    ASSERT_NE(mkdtemp(dataDir), (char *)NULL);
+    setenv("FLEDGE_DATA", dataDir, 1);
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("persistCache"), true);
+    config->setValue("hints", R"({ "Pump.*" : { "number" : "float32" }, "Camera.*" : { "number" : "float64" } })");
+    config->setValue("enable", "true");
+    config->setValue("persistCache", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    readings->push_back(new Reading("Camera1", new Datapoint("test", dpv)));
+    readings->push_back(new Reading("Motor1", new Datapoint("test", dpv)));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+    delete outReadings;
+    plugin_shutdown(handle);
+
+    string cacheFile = string(dataDir) + "/omfhint/omfhint.cache";
+    ifstream in(cacheFile);
+    ASSERT_EQ(in.good(), true);
+    stringstream content;
+    content << in.rdbuf();
+    ASSERT_NE(content.str().find("1 7:Camera1\n"), string::npos);
+    ASSERT_NE(content.str().find("-1 6:Motor1\n"), string::npos);
+
+    unlink(cacheFile.c_str());
+    rmdir((string(dataDir) + "/omfhint").c_str());
+    rmdir(dataDir);
+    unsetenv("FLEDGE_DATA");
+    delete config;
+}
+
+// Testing readings are forwarded in chunks
+TEST(OMFHINT, OmfHintChunkedForwarding)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("chunkSize"), true);
+    config->setValue("hints", R"({ "Pump.*" : { "number" : "float32" } })");
+    config->setValue("enable", "true");
+    config->setValue("chunkSize", "2");
+
+    vector<size_t> chunks;
+    void *handle = plugin_init(config, &chunks, ChunkHandler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    for (int i = 0; i < 5; i++)
+    {
+        readings->push_back(new Reading("Pump" + to_string(i), new Datapoint("test", dpv)));
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    // Three chunks, every reading has a hint
+    ASSERT_EQ(chunks.size(), 3);
+    ASSERT_EQ(chunks[0], 2);
+    ASSERT_EQ(chunks[1], 2);
+    ASSERT_EQ(chunks[2], 1);
+
+    delete config;
+    plugin_shutdown(handle);
+}
+
+// Testing pipelined ingest forwards every chunk, in order, before returning
+TEST(OMFHINT, OmfHintPipelined)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("pipelined"), true);
+    ASSERT_EQ(config->itemExists("queueDepth"), true);
+    config->setValue("hints", R"({ "Pump.*" : { "number" : "float32" } })");
+    config->setValue("enable", "true");
+    config->setValue("pipelined", "true");
+    config->setValue("queueDepth", "1");
+    config->setValue("chunkSize", "2");
+
+    vector<string> assets;
+    void *handle = plugin_init(config, &assets, PipelineHandler);
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    for (int set = 0; set < 10; set++)
+    {
+        vector<Reading *> *readings = new vector<Reading *>;
+        for (int i = 0; i < 5; i++)
+        {
+            readings->push_back(new Reading("Pump" + to_string(set * 5 + i), new Datapoint("test", dpv)));
+        }
+        ReadingSet *readingSet = new ReadingSet(readings);
+        readings->clear();
+        delete readings;
+        plugin_ingest(handle, (READINGSET *)readingSet);
+
+        // The whole set has been forwarded when plugin_ingest returns
+        ASSERT_EQ(assets.size(), (set + 1) * 5);
+    }
+
+    for (int i = 0; i < 50; i++)
+    {
+        ASSERT_EQ(assets[i], "Pump" + to_string(i));
+    }
+    delete config;
+    plugin_shutdown(handle);
+}
+
+// Testing hints selected by the datapoints in the reading
+TEST(OMFHINT, OmfHintSchemaHints)
+{
+    const char *schemaJSON = R"({
+        "modbus_1" : [
+            { "datapoints" : [ "flow", "pressure" ], "hint" : { "typeName" : "pump" } },
+            { "datapoints" : [ "voltage" ], "hint" : { "typeName" : "meter" } }
+        ]
+    })";
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("schemaHints"), true);
+    config->setValue("hints", R"({ ".*" : { "number" : "float32" } })");
+    config->setValue("schemaHints", schemaJSON);
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    for (int i = 0; i < 2; i++)
+    {
+        vector<Datapoint *> pump;
+        pump.push_back(new Datapoint("pressure", dpv));
+        pump.push_back(new Datapoint("flow", dpv));
+        readings->push_back(new Reading("modbus_1", pump));
+    }
+    vector<Datapoint *> meter;
+    meter.push_back(new Datapoint("voltage", dpv));
+    meter.push_back(new Datapoint("current", dpv));
+    readings->push_back(new Reading("modbus_1", meter));
+    readings->push_back(new Reading("modbus_1", new Datapoint("flow", dpv)));
+    readings->push_back(new Reading("modbus_2", new Datapoint("voltage", dpv)));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *> results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 5);
+    const char *expected[] = {
+        "\"{\\\"typeName\\\":\\\"pump\\\"}\"",
+        "\"{\\\"typeName\\\":\\\"pump\\\"}\"",
+        "\"{\\\"typeName\\\":\\\"meter\\\"}\"",
+        "\"{\\\"number\\\":\\\"float32\\\"}\"",
+        "\"{\\\"number\\\":\\\"float32\\\"}\""
+    };
+    for (int i = 0; i < 5; i++)
+    {
+        Datapoint *outdp = results[i]->getDatapoint("OMFHint");
+        ASSERT_NE(outdp, (Datapoint *)NULL);
+        ASSERT_STREQ(outdp->getData().toString().c_str(), expected[i]);
+    }
+
+    delete config;
+    delete outReadings;
+    plugin_shutdown(handle);
+}
+
+// Testing macros that refer to datapoints within dictionary and list datapoints
+TEST(OMFHINT, OmfHintNestedMacro)
+{
+    const char *hintsJSON = R"({"Camera": {"AFLocation" : "/UK/$meta.serial$/$meta.ports.1$/$meta.missing$" }})";
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    config->setValue("hints", hintsJSON);
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    vector<Datapoint *> *ports = new vector<Datapoint *>;
+    DatapointValue port1((long)8080);
+    ports->push_back(new Datapoint("port", port1));
+    DatapointValue port2((long)8081);
+    ports->push_back(new Datapoint("port", port2));
+    DatapointValue portsDpv(ports, false);
+
+    vector<Datapoint *> *meta = new vector<Datapoint *>;
+    DatapointValue serialDpv(string("SN123"));
+    meta->push_back(new Datapoint("serial", serialDpv));
+    meta->push_back(new Datapoint("ports", portsDpv));
+    DatapointValue metaDpv(meta, true);
+
+    readings->push_back(new Reading("Camera", new Datapoint("meta", metaDpv)));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *> results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 1);
+    Datapoint *outdp = results[0]->getDatapoint("OMFHint");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_STREQ(outdp->getData().toString().c_str(),  "\"{\\\"AFLocation\\\":\\\"/UK/SN123/8081/$meta.missing$\\\"}\"");
+
+    delete config;
+    delete outReadings;
+    plugin_shutdown(handle);
+}
+
+// Testing reading timestamp macros
+TEST(OMFHINT, OmfHintTimestampMacro)
+{
+    const char *hintsJSON = R"({"Camera": {"AFLocation" : "/UK/$USER_DATE$/$ASSET$", "source" : "$USER_TS$" }})";
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    config->setValue("hints", hintsJSON);
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    struct timeval userTs[] = { { 1700000000, 42 }, { 1700000000, 999999 }, { 1700086400, 0 } };
+    for (int i = 0; i < 3; i++)
+    {
+        Reading *in = new Reading("Camera", new Datapoint("test", dpv));
+        in->setUserTimestamp(userTs[i]);
+        readings->push_back(in);
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *> results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 3);
+    const char *expected[] = {
+        "\"{\\\"AFLocation\\\":\\\"/UK/2023-11-14/Camera\\\",\\\"source\\\":\\\"2023-11-14 22:13:20.000042\\\"}\"",
+        "\"{\\\"AFLocation\\\":\\\"/UK/2023-11-14/Camera\\\",\\\"source\\\":\\\"2023-11-14 22:13:20.999999\\\"}\"",
+        "\"{\\\"AFLocation\\\":\\\"/UK/2023-11-15/Camera\\\",\\\"source\\\":\\\"2023-11-15 22:13:20.000000\\\"}\""
+    };
+    for (int i = 0; i < 3; i++)
+    {
+        Datapoint *outdp = results[i]->getDatapoint("OMFHint");
+        ASSERT_NE(outdp, (Datapoint *)NULL);
+        ASSERT_STREQ(outdp->getData().toString().c_str(), expected[i]);
+    }
+
+    delete config;
+    delete outReadings;
+    plugin_shutdown(handle);
+}
+
+// Testing case insensitive asset name matching
+TEST(OMFHINT, OmfHintCaseInsensitive)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("caseInsensitive"), true);
+    config->setValue("hints", R"({ "Pump1" : { "number" : "float32" }, "motor.*" : { "number" : "float64" } })");
+    config->setValue("enable", "true");
+    config->setValue("caseInsensitive", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    readings->push_back(new Reading("PUMP1", new Datapoint("test", dpv)));
+    readings->push_back(new Reading("pump1", new Datapoint("test", dpv)));
+    readings->push_back(new Reading("MOTOR7", new Datapoint("test", dpv)));
+    readings->push_back(new Reading("Pump2", new Datapoint("test", dpv)));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *> results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 4);
+    Datapoint *outdp = results[0]->getDatapoint("OMFHint");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_STREQ(outdp->getData().toString().c_str(), "\"{\\\"number\\\":\\\"float32\\\"}\"");
+    outdp = results[1]->getDatapoint("OMFHint");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_STREQ(outdp->getData().toString().c_str(), "\"{\\\"number\\\":\\\"float32\\\"}\"");
+    outdp = results[2]->getDatapoint("OMFHint");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_STREQ(outdp->getData().toString().c_str(), "\"{\\\"number\\\":\\\"float64\\\"}\"");
+    ASSERT_EQ(results[3]->getDatapoint("OMFHint"), (Datapoint *)NULL);
+    // The asset name itself is not changed
+    ASSERT_STREQ(results[0]->getAssetName().c_str(), "PUMP1");
+
+    delete config;
+    delete outReadings;
+    plugin_shutdown(handle);
+}
+
+// Testing the content hash hint ID
+TEST(OMFHINT, OmfHintContentId)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("hintId"), true);
+    config->setValue("hints", R"({ "Pump.*" : { "number" : "float32" }, "Camera" : { "AFLocation" : "/UK/$city$" } })");
+    config->setValue("enable", "true");
+    config->setValue("hintId", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    readings->push_back(new Reading("Pump1", new Datapoint("test", dpv)));
+    readings->push_back(new Reading("Pump2", new Datapoint("test", dpv)));
+    DatapointValue london(string("London"));
+    readings->push_back(new Reading("Camera", new Datapoint("city", london)));
+    DatapointValue paris(string("Paris"));
+    readings->push_back(new Reading("Camera", new Datapoint("city", paris)));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *> results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 4);
+    vector<string> ids;
+    for (auto reading : results)
+    {
+        Datapoint *id = reading->getDatapoint("OMFHintId");
+        ASSERT_NE(id, (Datapoint *)NULL);
+        ASSERT_EQ(id->getData().toStringValue().length(), 16);
+        ids.push_back(id->getData().toStringValue());
+    }
+    // Identical hints share an ID, different rendered hints do not
+    ASSERT_EQ(ids[0], ids[1]);
+    ASSERT_NE(ids[0], ids[2]);
+    ASSERT_NE(ids[2], ids[3]);
+
+    delete config;
+    delete outReadings;
+    plugin_shutdown(handle);
+}
+
+// Testing MessagePack hints are decoded to the same JSON as the JSON format
+TEST(OMFHINT, OmfHintMessagePack)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("hintFormat"), true);
+    ASSERT_EQ(config->itemExists("decodeHints"), true);
+    const char *hints = R"({ "Pump.*" : { "number" : "float32", "minimum" : -40, "maximum" : 120.5 }, "Camera" : { "AFLocation" : "/UK/$city$" } })";
+    config->setValue("hints", hints);
+    config->setValue("enable", "true");
+
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    DatapointValue london(string("London"));
+    vector<string> expected;
+    for (int format = 0; format < 2; format++)
+    {
+        config->setValue("hintFormat", format ? "MessagePack" : "JSON");
+        ReadingSet *outReadings;
+        void *handle = plugin_init(config, &outReadings, Handler);
+        vector<Reading *> *readings = new vector<Reading *>;
+        readings->push_back(new Reading("Pump1", new Datapoint("test", dpv)));
+        readings->push_back(new Reading("Camera", new Datapoint("city", london)));
+        ReadingSet *readingSet = new ReadingSet(readings);
+        readings->clear();
+        delete readings;
+        plugin_ingest(handle, (READINGSET *)readingSet);
+        plugin_shutdown(handle);
+
+        vector<Reading *> results = outReadings->getAllReadings();
+        ASSERT_EQ(results.size(), 2);
+        if (format == 0)
+        {
+            for (auto reading : results)
+            {
+                Datapoint *hint = reading->getDatapoint("OMFHint");
+                ASSERT_NE(hint, (Datapoint *)NULL);
+                expected.push_back(hint->getData().toStringValue());
+            }
+            delete outReadings;
+            continue;
+        }
+
+        for (auto reading : results)
+        {
+            Datapoint *hint = reading->getDatapoint("OMFHint");
+            ASSERT_NE(hint, (Datapoint *)NULL);
+            ASSERT_EQ(hint->getData().getType(), DatapointValue::T_DATABUFFER);
+        }
+
+        // A second filter decodes the hints
+        ConfigCategory *decodeConfig = new ConfigCategory("omfhint", info->config);
+        decodeConfig->setItemsValueFromDefault();
+        decodeConfig->setValue("hints", "{}");
+        decodeConfig->setValue("enable", "true");
+        decodeConfig->setValue("decodeHints", "true");
+        ReadingSet *decoded;
+        handle = plugin_init(decodeConfig, &decoded, Handler);
+        plugin_ingest(handle, (READINGSET *)outReadings);
+        plugin_shutdown(handle);
+
+        results = decoded->getAllReadings();
+        ASSERT_EQ(results.size(), 2);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            Datapoint *hint = results[i]->getDatapoint("OMFHint");
+            ASSERT_NE(hint, (Datapoint *)NULL);
+            ASSERT_EQ(hint->getData().getType(), DatapointValue::T_STRING);
+            ASSERT_EQ(hint->getData().toStringValue(), expected[i]);
+        }
+        delete decodeConfig;
+        delete decoded;
+    }
+    delete config;
+}
+
+// Testing sampled readings are written to the trace file
+TEST(OMFHINT, OmfHintTrace)
+{
+    char dataDir[] = "/tmp/omfhintXXXXXX";
+    ASSERT_NE(mkdtemp(dataDir), (char *)NULL);
+    setenv("FLEDGE_DATA", dataDir, 1);
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    ASSERT_EQ(config->itemExists("trace"), true);
+    ASSERT_EQ(config->itemExists("traceSampleRate"), true);
+    config->setValue("hints", R"({ "Pump.*" : { "number" : "float32" } })");
+    config->setValue("enable", "true");
+    config->setValue("trace", "true");
+    config->setValue("traceSampleRate", "2");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    for (int i = 0; i < 4; i++)
+    {
+        readings->push_back(new Reading("Pump" + to_string(i), new Datapoint("test", dpv)));
+    }
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+    delete outReadings;
+    plugin_shutdown(handle);
+
+    string traceFile = string(dataDir) + "/omfhint/omfhint.trace.json";
+    ifstream in(traceFile);
+    ASSERT_EQ(in.good(), true);
+    stringstream content;
+    content << in.rdbuf();
+    Document doc;
+    doc.Parse(content.str().c_str());
+    ASSERT_FALSE(doc.HasParseError());
+    ASSERT_TRUE(doc.IsArray());
+
+    // Every second reading is traced, the new assets are matched by regex
+    int traced = 0, regex = 0;
+    for (auto& event : doc.GetArray())
+    {
+        ASSERT_STREQ(event["ph"].GetString(), "X");
+        string name = event["name"].GetString();
+        if (name == "reading")
+            traced++;
+        else if (name == "regex")
+            regex++;
+    }
+    ASSERT_EQ(traced, 2);
+    ASSERT_EQ(regex, 2);
+
+    unlink(traceFile.c_str());
+    rmdir((string(dataDir) + "/omfhint").c_str());
+    rmdir(dataDir);
+    unsetenv("FLEDGE_DATA");
+    delete config;
+}
+
+// Testing a change of trace sample rate replaces the trace file
+TEST(OMFHINT, OmfHintTraceReconfigure)
+{
+    char dataDir[] = "/tmp/omfhintXXXXXX";
+    ASSERT_NE(mkdtemp(dataDir), (char *)NULL);
+    setenv("FLEDGE_DATA", dataDir, 1);
+
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("omfhint", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+    config->setValue("hints", R"({ "Pump.*" : { "number" : "float32" } })");
+    config->setValue("enable", "true");
+    config->setValue("trace", "true");
+    config->setValue("traceSampleRate", "2");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    long testValue = 2;
+    DatapointValue dpv(testValue);
+    for (int set = 0; set < 2; set++)
+    {
+        if (set == 1)
+        {
+            config->setValue("traceSampleRate", "1");
+            plugin_reconfigure(handle, config->itemsToJSON());
+        }
+        vector<Reading *> *readings = new vector<Reading *>;
+        for (int i = 0; i < 4; i++)
+        {
+            readings->push_back(new Reading("Pump" + to_string(set * 4 + i), new Datapoint("test", dpv)));
+        }
+        ReadingSet *readingSet = new ReadingSet(readings);
+        readings->clear();
+        delete readings;
+        plugin_ingest(handle, (READINGSET *)readingSet);
+        delete outReadings;
+    }
+    plugin_shutdown(handle);
+
+    string traceFile = string(dataDir) + "/omfhint/omfhint.trace.json";
+    ifstream in(traceFile);
+    ASSERT_EQ(in.good(), true);
+    stringstream content;
+    content << in.rdbuf();
+    Document doc;
+    doc.Parse(content.str().c_str());
+    ASSERT_FALSE(doc.HasParseError());
+    ASSERT_TRUE(doc.IsArray());
+
+    // Only the readings traced after the change, every one of them, remain
+    int traced = 0;
+    for (auto& event : doc.GetArray())
+    {
+        if (string(event["name"].GetString()) == "reading")
+            traced++;
+    }
+    ASSERT_EQ(traced, 4);
+
+    unlink(traceFile.c_str());
+    rmdir((string(dataDir) + "/omfhint").c_str());
+    rmdir(dataDir);
+    unsetenv("FLEDGE_DATA");
+    delete config;
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <omfhint_rules.h>
+#include <rapidjson/document.h>
+#include <string>
+
+using namespace std;
+using namespace rapidjson;
+
+static const string hints = "{\"motor1\":{\"number\":\"float32\"},\"pump.*\":{\"number\":\"float64\"}}";
+
+TEST(OMFHINT_RULES, SharedRuleSet)
+{
+    shared_ptr<const OMFHintRuleSet> first = OMFHintRuleSet::get(hints, "{}", false);
+    shared_ptr<const OMFHintRuleSet> second = OMFHintRuleSet::get(hints, "{}", false);
+    ASSERT_EQ(first.get(), second.get());
+    ASSERT_EQ(first->hash(), second->hash());
+}
+
+TEST(OMFHINT_RULES, DistinctRuleSets)
+{
+    shared_ptr<const OMFHintRuleSet> rules = OMFHintRuleSet::get(hints, "{}", false);
+    shared_ptr<const OMFHintRuleSet> icase = OMFHintRuleSet::get(hints, "{}", true);
+    shared_ptr<const OMFHintRuleSet> other = OMFHintRuleSet::get("{\"motor2\":{\"number\":\"float32\"}}", "{}", false);
+    ASSERT_NE(rules.get(), icase.get());
+    ASSERT_NE(rules.get(), other.get());
+    ASSERT_NE(rules->hash(), icase->hash());
+    ASSERT_TRUE(icase->caseInsensitive());
+    ASSERT_FALSE(rules->caseInsensitive());
+}
+
+TEST(OMFHINT_RULES, ReleasedRuleSet)
+{
+    shared_ptr<const OMFHintRuleSet> rules = OMFHintRuleSet::get("{\"released\":{\"number\":\"int16\"}}", "{}", false);
+    weak_ptr<const OMFHintRuleSet> weak = rules;
+    rules.reset();
+    ASSERT_TRUE(weak.expired());
+}
+
+TEST(OMFHINT_RULES, MatchRules)
+{
+    shared_ptr<const OMFHintRuleSet> rules = OMFHintRuleSet::get(hints, "{}", false);
+    ASSERT_NE(rules->exactHint("motor1"), (const OMFHint *)NULL);
+    ASSERT_EQ(rules->exactHint("motor2"), (const OMFHint *)NULL);
+    ASSERT_EQ(rules->wildcardCount(), 1U);
+    int index = rules->matchWildcard("pump42");
+    ASSERT_EQ(index, 0);
+    ASSERT_NE(rules->wildcardHint(index)->json.find("float64"), string::npos);
+    ASSERT_EQ(rules->matchWildcard("motor2"), -1);
+    ASSERT_FALSE(rules->hasSchemaHints());
+}
+
+TEST(OMFHINT_RULES, RuleReport)
+{
+    shared_ptr<const OMFHintRuleSet> rules = OMFHintRuleSet::get(R"({
+        "Pump.1" : { "number" : "float32" },
+        "Pump\\.1" : { "number" : "float64" },
+        "Motor.*" : { "number" : "float16" },
+        "Motor.*" : { "number" : "float64" },
+        "Fan\\.2" : { "integer" : "uint16" },
+        ".*" : { "integer" : "int32" },
+        "Valve.*" : { "integer" : "int16" }
+    })", "{}", false);
+
+    Document doc;
+    doc.Parse(rules->ruleReport().c_str());
+    ASSERT_EQ(doc.HasParseError(), false);
+    ASSERT_EQ(doc["rules"].Size(), 7);
+    ASSERT_STREQ(doc["rules"][0]["status"].GetString(), "active");
+    ASSERT_STREQ(doc["rules"][1]["status"].GetString(), "shadowed");
+    ASSERT_STREQ(doc["rules"][1]["shadowedBy"].GetString(), "Pump.1");
+    ASSERT_STREQ(doc["rules"][2]["status"].GetString(), "active");
+    ASSERT_STREQ(doc["rules"][3]["status"].GetString(), "duplicate");
+    ASSERT_STREQ(doc["rules"][4]["status"].GetString(), "promoted");
+    ASSERT_STREQ(doc["rules"][5]["status"].GetString(), "active");
+    ASSERT_STREQ(doc["rules"][6]["status"].GetString(), "shadowed");
+    ASSERT_STREQ(doc["rules"][6]["shadowedBy"].GetString(), ".*");
+    ASSERT_EQ(doc["unreachable"].GetUint(), 3);
+    ASSERT_EQ(doc["wildcards"].GetUint(), 3);
+}
+
+TEST(OMFHINT_RULES, ConfigureDiagnostics)
+{
+    HintDiagnostics diagnostics;
+    OMFHintRuleSet::get(R"({ "Pump[1" : { "number" : "float32" }, "motor1" : { "number" : "float32" } })",
+            "{}", false, HINT_FORMAT_JSON, false, &diagnostics);
+    ASSERT_EQ(diagnostics.suppressed(), 0UL);
+
+    // The same invalid regular expression in new hints is only counted
+    OMFHintRuleSet::get(R"({ "Pump[1" : { "number" : "float32" }, "motor2" : { "number" : "float32" } })",
+            "{}", false, HINT_FORMAT_JSON, false, &diagnostics);
+    ASSERT_EQ(diagnostics.suppressed(), 1UL);
+}